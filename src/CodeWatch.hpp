@@ -0,0 +1,115 @@
+#ifndef CODE_WATCH_HPP
+#define CODE_WATCH_HPP
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "RingBuffer_QueueItems.hpp"
+
+// NOTICE:
+// Self modifying code detection for JIT translation caches.
+// The JIT marks the guest pages it translated as watched. A WRITE to a watched page
+// posts a code_write_event after the write is done and unwatches the page again,
+// the JIT drops its translations of that page and watches it again after retranslating.
+// The producer (store path) does not check anything, the controller only checks the
+// bitmap while at least one page is watched.
+// WRITEs stay posted: before the JIT runs a translation it calls flush_writes() (controller or
+// handler) and drains the events afterwards.
+// If the JIT does not drain the events fast enough the ring overflows:
+// overflowed() returns true once and the JIT has to drop all translations.
+
+#define CODE_PAGE_SHIFT 12
+#define CODE_PAGE_SIZE (1ULL << CODE_PAGE_SHIFT)
+#define MAX_CODE_EVENTS 256
+
+struct code_write_event {
+    uint64_t page_address = 0; // watched page, relative to the controller (+ _guest_base = guest address)
+    uint64_t address = 0;      // address of the WRITE, relative to the controller
+    uint64_t size = 0;
+};
+
+class CodeWatch {
+    public:
+        CodeWatch() = default;
+
+        // allocates the bitmap, call before the controller is started
+        bool init(uint64_t mem_size) {
+            _pages = (mem_size + CODE_PAGE_SIZE - 1) >> CODE_PAGE_SHIFT;
+            _words = (_pages + 63) / 64;
+            _bitmap.reset(new std::atomic<uint64_t>[_words]);
+            for(uint64_t i = 0; i < _words; i++) {
+                _bitmap[i].store(0, std::memory_order_relaxed);
+            }
+            _watched.store(0, std::memory_order_relaxed);
+            return true;
+        }
+        bool enabled() const { return _bitmap != nullptr; }
+        // true if at least one page is watched -> the controller checks the WRITEs
+        inline bool active() const { return _watched.load(std::memory_order_relaxed) != 0; }
+
+        // JIT side, can be called while the controller runs:
+        void watch(uint64_t address, uint64_t length) { update(address, length, true); }
+        void unwatch(uint64_t address, uint64_t length) { update(address, length, false); }
+        bool is_watched(uint64_t address) const {
+            uint64_t page = address >> CODE_PAGE_SHIFT;
+            if(page >= _pages) {
+                return false;
+            }
+            return _bitmap[page >> 6].load(std::memory_order_acquire) & (1ULL << (page & 63));
+        }
+        bool pop_event(code_write_event* event) { return _events.consumer_pop(event); }
+        bool overflowed() { return _overflow.exchange(false, std::memory_order_acq_rel); }
+        uint64_t watched_pages() const { return _watched.load(std::memory_order_relaxed); }
+
+        // controller side: after a WRITE of [address, address+size) was done
+        inline void on_write(uint64_t address, uint64_t size) {
+            uint64_t first = address >> CODE_PAGE_SHIFT;
+            uint64_t last = (address + (size ? size - 1 : 0)) >> CODE_PAGE_SHIFT;
+            for(uint64_t page = first; page <= last && page < _pages; page++) {
+                uint64_t bit = 1ULL << (page & 63);
+                if(!(_bitmap[page >> 6].load(std::memory_order_relaxed) & bit)) {
+                    continue;
+                }
+                // only one event per page until the JIT watches it again
+                if(!(_bitmap[page >> 6].fetch_and(~bit, std::memory_order_acq_rel) & bit)) {
+                    continue;
+                }
+                _watched.fetch_sub(1, std::memory_order_relaxed);
+                code_write_event event;
+                event.page_address = page << CODE_PAGE_SHIFT;
+                event.address = address;
+                event.size = size;
+                if(!_events.producer_push(event)) {
+                    _overflow.store(true, std::memory_order_release);
+                }
+            }
+        }
+
+    private:
+        void update(uint64_t address, uint64_t length, bool set) {
+            if(!enabled() || length == 0) {
+                return;
+            }
+            uint64_t last = (address + length - 1) >> CODE_PAGE_SHIFT;
+            for(uint64_t page = address >> CODE_PAGE_SHIFT; page <= last && page < _pages; page++) {
+                uint64_t bit = 1ULL << (page & 63);
+                if(set) {
+                    if(!(_bitmap[page >> 6].fetch_or(bit, std::memory_order_acq_rel) & bit)) {
+                        _watched.fetch_add(1, std::memory_order_relaxed);
+                    }
+                } else {
+                    if(_bitmap[page >> 6].fetch_and(~bit, std::memory_order_acq_rel) & bit) {
+                        _watched.fetch_sub(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+        }
+
+        uint64_t _pages = 0;
+        uint64_t _words = 0;
+        std::unique_ptr<std::atomic<uint64_t>[]> _bitmap;
+        std::atomic<uint64_t> _watched = 0;
+        SlotRing<MAX_CODE_EVENTS, code_write_event> _events;
+        std::atomic<bool> _overflow = false;
+};
+
+#endif // CODE_WATCH_HPP
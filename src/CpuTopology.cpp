@@ -0,0 +1,246 @@
+#include "CpuTopology.hpp"
+#include "Logger.hpp"
+#include <dirent.h>
+#include <fstream>
+#include <sched.h>
+#include <cstring>
+#include <cstdlib>
+
+#define SYSFS_CPU_PATH "/sys/devices/system/cpu/"
+
+bool CpuTopology::read_line(const std::string& path, std::string& out) {
+    std::ifstream file(path);
+    if(!file.is_open()) {
+        return false;
+    }
+    return (bool)std::getline(file, out);
+}
+
+int CpuTopology::read_int(const std::string& path, int fallback) {
+    std::string line;
+    if(!read_line(path, line) || line.empty()) {
+        return fallback;
+    }
+    return std::atoi(line.c_str());
+}
+
+// parses the sysfs list format: "0-3,8,10-11"
+std::vector<int> CpuTopology::parse_cpu_list(const std::string& list) {
+    std::vector<int> out;
+    size_t pos = 0;
+    while(pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if(end == std::string::npos) {
+            end = list.size();
+        }
+        std::string part = list.substr(pos, end - pos);
+        size_t dash = part.find('-');
+        if(!part.empty()) {
+            int first = std::atoi(part.c_str());
+            int last = dash == std::string::npos ? first : std::atoi(part.c_str() + dash + 1);
+            for(int i = first; i <= last; i++) {
+                out.push_back(i);
+            }
+        }
+        pos = end + 1;
+    }
+    return out;
+}
+
+bool CpuTopology::load() {
+    _cpus.clear();
+    _loaded = false;
+    std::string online;
+    if(!read_line(SYSFS_CPU_PATH "online", online)) {
+#ifdef DEBUG
+        LOG_DEBUG("[TOPOLOGY]: sysfs not available");
+#endif
+        return false;
+    }
+    for(int cpu : parse_cpu_list(online)) {
+        std::string base = SYSFS_CPU_PATH "cpu" + std::to_string(cpu) + "/";
+        cpu_info info;
+        info.cpu = cpu;
+        info.core_id = read_int(base + "topology/core_id", cpu);
+        info.package_id = read_int(base + "topology/physical_package_id", 0);
+        // search the cache index with level 3
+        for(int index = 0; index < 8; index++) {
+            std::string cache = base + "cache/index" + std::to_string(index) + "/";
+            int level = read_int(cache + "level", -1);
+            if(level == -1) {
+                break;
+            }
+            if(level != 3) {
+                continue;
+            }
+            info.l3_id = read_int(cache + "id", -1);
+            if(info.l3_id == -1) {
+                // older kernels have no id -> use the first cpu sharing this cache
+                std::string shared;
+                if(read_line(cache + "shared_cpu_list", shared)) {
+                    std::vector<int> list = parse_cpu_list(shared);
+                    info.l3_id = list.empty() ? -1 : list[0];
+                }
+            }
+            break;
+        }
+        // the numa node is a "nodeX" link inside the cpu directory
+        DIR* dir = opendir(base.c_str());
+        if(dir != nullptr) {
+            struct dirent* entry;
+            while((entry = readdir(dir)) != nullptr) {
+                if(strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+                    info.numa_node = std::atoi(entry->d_name + 4);
+                    break;
+                }
+            }
+            closedir(dir);
+        }
+        if(info.numa_node == -1) {
+            info.numa_node = 0;
+        }
+        if(info.l3_id == -1) {
+            // no l3 information -> treat the package as one l3 domain
+            info.l3_id = info.package_id;
+        }
+#ifdef DEBUG
+        LOG_DEBUG("[TOPOLOGY]: cpu: "+std::to_string(info.cpu)+" core: "+std::to_string(info.core_id)+" package: "+std::to_string(info.package_id)+" l3: "+std::to_string(info.l3_id)+" node: "+std::to_string(info.numa_node));
+#endif
+        _cpus.push_back(info);
+    }
+    _loaded = !_cpus.empty();
+    return _loaded;
+}
+
+const cpu_info* CpuTopology::get(int cpu) const {
+    for(const cpu_info& info : _cpus) {
+        if(info.cpu == cpu) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+bool CpuTopology::same_core(int a, int b) const {
+    const cpu_info* ia = get(a);
+    const cpu_info* ib = get(b);
+    if(ia == nullptr || ib == nullptr) {
+        return false;
+    }
+    return ia->package_id == ib->package_id && ia->core_id == ib->core_id;
+}
+
+bool CpuTopology::same_l3(int a, int b) const {
+    const cpu_info* ia = get(a);
+    const cpu_info* ib = get(b);
+    if(ia == nullptr || ib == nullptr) {
+        return false;
+    }
+    return ia->package_id == ib->package_id && ia->l3_id == ib->l3_id;
+}
+
+bool CpuTopology::same_node(int a, int b) const {
+    const cpu_info* ia = get(a);
+    const cpu_info* ib = get(b);
+    if(ia == nullptr || ib == nullptr) {
+        return false;
+    }
+    return ia->numa_node == ib->numa_node;
+}
+
+bool CpuTopology::matches(int producer_cpu, int cpu, placement where) const {
+    switch(where) {
+        case placement::SAME_CPU: {
+            return cpu == producer_cpu;
+        }
+        case placement::SMT_SIBLING: {
+            return cpu != producer_cpu && same_core(cpu, producer_cpu);
+        }
+        case placement::SAME_L3: {
+            return !same_core(cpu, producer_cpu) && same_l3(cpu, producer_cpu);
+        }
+        case placement::SAME_NODE: {
+            return !same_core(cpu, producer_cpu) && !same_l3(cpu, producer_cpu) && same_node(cpu, producer_cpu);
+        }
+        case placement::REMOTE_NODE: {
+            return !same_node(cpu, producer_cpu);
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+bool CpuTopology::is_taken(int cpu, const std::vector<int>& taken) const {
+    for(int t : taken) {
+        if(t == cpu || same_core(t, cpu)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int CpuTopology::find_cpu(int producer_cpu, placement where, const std::vector<int>& taken) const {
+    if(where == placement::UNPINNED) {
+        return -1;
+    }
+    if(where == placement::NEAREST) {
+        int cpu = find_cpu(producer_cpu, placement::SAME_L3, taken);
+        if(cpu == -1) {
+            cpu = find_cpu(producer_cpu, placement::SAME_NODE, taken);
+        }
+        if(cpu == -1) {
+            cpu = find_cpu(producer_cpu, placement::REMOTE_NODE, taken);
+        }
+        return cpu;
+    }
+    bool skip_taken = where != placement::SAME_CPU && where != placement::SMT_SIBLING;
+    for(const cpu_info& info : _cpus) {
+        if(skip_taken && is_taken(info.cpu, taken)) {
+            continue;
+        }
+        if(matches(producer_cpu, info.cpu, where)) {
+            return info.cpu;
+        }
+    }
+    return -1;
+}
+
+bool CpuTopology::pin_thread(pthread_t thread, int cpu) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if(cpu < 0) {
+        for(int i = 0; i < CPU_SETSIZE; i++) {
+            CPU_SET(i, &cpuset);
+        }
+    } else {
+        CPU_SET(cpu, &cpuset);
+    }
+    int ret = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
+    if(ret != 0) {
+        std::cerr << "[TOPOLOGY]: pinning to cpu " << cpu << " failed: " << strerror(ret) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool CpuTopology::pin_current_thread(int cpu) {
+    return pin_thread(pthread_self(), cpu);
+}
+
+int CpuTopology::current_cpu() {
+    return sched_getcpu();
+}
+
+const char* CpuTopology::placement_name(placement where) {
+    switch(where) {
+        case placement::UNPINNED: return "UNPINNED";
+        case placement::SAME_CPU: return "SAME_CPU";
+        case placement::SMT_SIBLING: return "SMT_SIBLING";
+        case placement::SAME_L3: return "SAME_L3";
+        case placement::SAME_NODE: return "SAME_NODE";
+        case placement::REMOTE_NODE: return "REMOTE_NODE";
+        case placement::NEAREST: return "NEAREST";
+        default: return "UNKNOWN";
+    }
+}
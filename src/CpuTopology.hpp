@@ -0,0 +1,74 @@
+#ifndef CPU_TOPOLOGY_HPP
+#define CPU_TOPOLOGY_HPP
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+// NOTICE:
+// The topology is read once from sysfs (/sys/devices/system/cpu) and is used
+// to place the controller threads near their producers.
+// A controller should never share a physical core with its producer (SMT siblings
+// fight for the same execution units while spinning) but it should share the L3 or
+// at least the NUMA node so the queue cachelines dont have to cross the socket.
+
+struct cpu_info {
+    int cpu = -1;
+    int core_id = -1;
+    int package_id = -1;
+    int l3_id = -1;
+    int numa_node = -1;
+};
+
+// placement of a controller relative to a producer cpu
+enum class placement {
+    UNPINNED = 0,   // scheduler decides
+    SAME_CPU,       // same logical cpu as the producer (worst case for spinning)
+    SMT_SIBLING,    // other hyperthread of the producers physical core
+    SAME_L3,        // different physical core, same L3 cache
+    SAME_NODE,      // different L3 but same NUMA node
+    REMOTE_NODE,    // different NUMA node
+    NEAREST,        // best available: SAME_L3 -> SAME_NODE -> anything but the producers core
+};
+
+class CpuTopology {
+    public:
+        CpuTopology() = default;
+
+        // reads the topology from sysfs, returns false if sysfs is not available
+        bool load();
+        bool loaded() const { return _loaded; }
+        const std::vector<cpu_info>& cpus() const { return _cpus; }
+        const cpu_info* get(int cpu) const;
+
+        bool same_core(int a, int b) const;
+        bool same_l3(int a, int b) const;
+        bool same_node(int a, int b) const;
+        // checks if cpu is in the relation "where" to the producer cpu
+        bool matches(int producer_cpu, int cpu, placement where) const;
+
+        // finds a cpu with the given relation to the producer cpu
+        // cpus in "taken" and cpus sharing a physical core with a taken cpu are skipped for
+        // SAME_L3, SAME_NODE, REMOTE_NODE and NEAREST
+        // returns -1 if no such cpu exists
+        int find_cpu(int producer_cpu, placement where, const std::vector<int>& taken = {}) const;
+
+        // pins the given thread to a single cpu, returns false on error
+        // cpu = -1 allows the thread to run on every cpu again
+        static bool pin_thread(pthread_t thread, int cpu);
+        static bool pin_current_thread(int cpu);
+        // returns the cpu the calling thread is running on right now
+        static int current_cpu();
+        static const char* placement_name(placement where);
+
+    private:
+        bool _loaded = false;
+        std::vector<cpu_info> _cpus;
+
+        bool is_taken(int cpu, const std::vector<int>& taken) const;
+        static std::vector<int> parse_cpu_list(const std::string& list);
+        static bool read_line(const std::string& path, std::string& out);
+        static int read_int(const std::string& path, int fallback);
+};
+
+#endif // CPU_TOPOLOGY_HPP
@@ -66,6 +66,7 @@ enum error_mem : uint64_t {
 enum error_critical : uint64_t {
     FAST_EXIT = 1ULL << 56, // Fast exit -> is used when a critical error occurs -> controlled crash
     UNDEFINED_CRITICAL_ERROR = 1ULL << 57,
+    CONTROLLER_LOST = 1ULL << 58, // the controller process of a shared memory channel is gone
 };
 
 
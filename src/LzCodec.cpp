@@ -0,0 +1,163 @@
+#include "LzCodec.hpp"
+#include <cstring>
+
+#define LZ_MIN_MATCH 4
+// the last match has to start 12 bytes before the end, the last 5 bytes are literals
+#define LZ_MF_LIMIT 12
+#define LZ_LAST_LITERALS 5
+#define LZ_HASH_BITS 12
+#define LZ_MAX_INPUT 65535
+
+static inline uint32_t lz_read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// writes the 255 byte extension of a length, returns false if dst is too small
+static inline bool lz_write_length(uint8_t*& op, const uint8_t* op_end, size_t length) {
+    while(length >= 255) {
+        if(op >= op_end) {
+            return false;
+        }
+        *op++ = 255;
+        length -= 255;
+    }
+    if(op >= op_end) {
+        return false;
+    }
+    *op++ = (uint8_t)length;
+    return true;
+}
+
+static inline bool lz_write_sequence(uint8_t*& op, const uint8_t* op_end, const uint8_t* literals, size_t literal_length,
+                                     size_t offset, size_t match_length, bool last) {
+    if(op >= op_end) {
+        return false;
+    }
+    uint8_t* token = op++;
+    size_t ml = last ? 0 : match_length - LZ_MIN_MATCH;
+    *token = (uint8_t)(((literal_length >= 15 ? 15 : literal_length) << 4) | (ml >= 15 ? 15 : ml));
+    if(literal_length >= 15 && !lz_write_length(op, op_end, literal_length - 15)) {
+        return false;
+    }
+    if((size_t)(op_end - op) < literal_length) {
+        return false;
+    }
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+    if(last) {
+        return true;
+    }
+    if(op_end - op < 2) {
+        return false;
+    }
+    *op++ = (uint8_t)(offset & 0xFF);
+    *op++ = (uint8_t)(offset >> 8);
+    if(ml >= 15 && !lz_write_length(op, op_end, ml - 15)) {
+        return false;
+    }
+    return true;
+}
+
+size_t lz_compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity) {
+    if(src_size > LZ_MAX_INPUT) {
+        return 0;
+    }
+    int32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0xFF, sizeof(table));
+    uint8_t* op = dst;
+    const uint8_t* op_end = dst + dst_capacity;
+    size_t ip = 0;
+    size_t anchor = 0;
+    if(src_size > LZ_MF_LIMIT) {
+        size_t match_start_limit = src_size - LZ_MF_LIMIT;
+        size_t match_end_limit = src_size - LZ_LAST_LITERALS;
+        while(ip < match_start_limit) {
+            uint32_t sequence = lz_read32(src + ip);
+            uint32_t h = lz_hash(sequence);
+            int32_t ref = table[h];
+            table[h] = (int32_t)ip;
+            if(ref < 0 || lz_read32(src + ref) != sequence) {
+                ip++;
+                continue;
+            }
+            size_t length = LZ_MIN_MATCH;
+            while(ip + length < match_end_limit && src[ref + length] == src[ip + length]) {
+                length++;
+            }
+            if(!lz_write_sequence(op, op_end, src + anchor, ip - anchor, ip - (size_t)ref, length, false)) {
+                return 0;
+            }
+            ip += length;
+            anchor = ip;
+        }
+    }
+    if(!lz_write_sequence(op, op_end, src + anchor, src_size - anchor, 0, 0, true)) {
+        return 0;
+    }
+    return (size_t)(op - dst);
+}
+
+size_t lz_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity) {
+    size_t ip = 0;
+    size_t op = 0;
+    while(ip < src_size) {
+        uint8_t token = src[ip++];
+        size_t literal_length = token >> 4;
+        if(literal_length == 15) {
+            uint8_t b;
+            do {
+                if(ip >= src_size) {
+                    return 0;
+                }
+                b = src[ip++];
+                literal_length += b;
+            } while(b == 255);
+        }
+        if(literal_length > src_size - ip || literal_length > dst_capacity - op) {
+            return 0;
+        }
+        memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if(ip == src_size) {
+            // last sequence has no match
+            break;
+        }
+        if(src_size - ip < 2) {
+            return 0;
+        }
+        size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if(offset == 0 || offset > op) {
+            return 0;
+        }
+        size_t match_length = token & 15;
+        if(match_length == 15) {
+            uint8_t b;
+            do {
+                if(ip >= src_size) {
+                    return 0;
+                }
+                b = src[ip++];
+                match_length += b;
+            } while(b == 255);
+        }
+        match_length += LZ_MIN_MATCH;
+        if(match_length > dst_capacity - op) {
+            return 0;
+        }
+        // the match can overlap the output -> byte copy
+        const uint8_t* match = dst + op - offset;
+        for(size_t i = 0; i < match_length; i++) {
+            dst[op + i] = match[i];
+        }
+        op += match_length;
+    }
+    return op;
+}
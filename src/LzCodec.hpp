@@ -0,0 +1,17 @@
+#ifndef LZ_CODEC_HPP
+#define LZ_CODEC_HPP
+#include <cstddef>
+#include <cstdint>
+
+// NOTICE:
+// Small LZ77 block codec for guest pages, the output uses the LZ4 block format
+// (token, literals, 16 bit offset, match length). Greedy matching with a single
+// hash table, tuned for 4K pages and not for ratio.
+// Both functions return 0 on error (output does not fit / corrupt input).
+
+// input size has to be <= 65535 bytes
+size_t lz_compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity);
+// returns the number of bytes written to dst
+size_t lz_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity);
+
+#endif // LZ_CODEC_HPP
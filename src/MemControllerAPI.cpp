@@ -1,14 +1,19 @@
 #include "MemControllerAPI.hpp"
+#include "SharedMemoryTransport.hpp"
+#include "NumaReplication.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <cerrno>
 
 void Memory_Controller_Core::debug_queue_bits() {
     std::cout << "Slot Status Bits:" << std::endl;
     for(int i = 0; i < QUEUE_SLOTS; i++)  {
-        std::cout << "Slot " << i << ": " << (int)queue_status_bitarray[i].load(std::memory_order_acquire) << std::endl;
+        std::cout << "Slot " << i << ": " << (int)channel->queue_status_bitarray[i].load(std::memory_order_acquire) << std::endl;
     }
 }
 
 void Memory_Controller_Core::debug_queue_bits(int index) {
-    std::cout << "Statusbit at index: " << index << " bit-state: " << (int)queue_status_bitarray[index].load(std::memory_order_acquire) << std::endl;
+    std::cout << "Statusbit at index: " << index << " bit-state: " << (int)channel->queue_status_bitarray[index].load(std::memory_order_acquire) << std::endl;
 }
 
 void Memory_Controller_Core::debug_errors()
@@ -47,52 +52,405 @@ void Memory_Controller_Core::debug_errors()
     }
 }
 
-void Memory_Controller_Core::init(uint64_t size)
+void Memory_Controller_Core::init(uint64_t size, uint64_t reserve)
 {
-    _mem_ptr = init_mem(size);
+    _mem_ptr = init_mem(size, reserve);
 #ifdef DEBUG
             LOG_INFO("[MEMORY CONTROLLER]: Mem_ptr address: "+std::to_string((uint64_t)_mem_ptr));
 #endif
-    for(int i = 0; i < QUEUE_SLOTS; i++) {
-        queue_status_bitarray[i] = 0;
+    for(int i = 0; i < QUEUE_STATUS_BYTES; i++) {
+        channel->queue_status_bitarray[i] = 0;
     }
 }
 
-void Memory_Controller_Core::start() {
+bool Memory_Controller_Core::init_shared(SharedMemorySegment& segment, uint32_t channel_index) {
+    queue_channel* shared_channel = segment.get_channel(channel_index);
+    if(shared_channel == nullptr || segment.memory() == nullptr) {
+        SET_MEM_ERROR(NULL_PTR_USAGE);
+        return false;
+    }
+    // the segment initialized the channel already, a second process must not reset it
+    channel = shared_channel;
+    _shared = true;
+    _mem_ptr = segment.memory();
+    _size = segment.memory_size();
+    _reserved_size = _size;
+    _min_address = (uint64_t)_mem_ptr;
+    _max_address = (uint64_t)_mem_ptr + _size;
+#ifdef DEBUG
+    LOG_INFO("[MEMORY CONTROLLER]: attached to shared memory, channel: "+std::to_string(channel_index)+" mem_ptr address: "+std::to_string((uint64_t)_mem_ptr));
+#endif
+    return true;
+}
+
+bool Memory_Controller_Core::init_replica(NumaReplicas& replicas, int node) {
+    uint8_t* replica = replicas.replica_of_node(node);
+    if(replica == nullptr) {
+        SET_MEM_ERROR(NULL_PTR_USAGE);
+        return false;
+    }
+    _replicas = &replicas;
+    _shared = true;
+    _mem_ptr = replica;
+    _size = replicas.size();
+    _reserved_size = _size;
+    _min_address = (uint64_t)_mem_ptr;
+    _max_address = (uint64_t)_mem_ptr + _size;
+    for(int i = 0; i < QUEUE_STATUS_BYTES; i++) {
+        channel->queue_status_bitarray[i] = 0;
+    }
+#ifdef DEBUG
+    LOG_INFO("[MEMORY CONTROLLER]: using replica of NUMA node: "+std::to_string(node));
+#endif
+    return true;
+}
+
+bool Memory_Controller_Core::take_over(Memory_Controller_Core& old) {
+    if(running || _joinable || _mem_ptr != nullptr || &old == this || old._mem_ptr == nullptr
+        || old._handed_over.load(std::memory_order_acquire) || (old._shared && old._replicas == nullptr)
+        || (old.running && old.compactor.enabled())) {
+        // the channel of a shared memory segment belongs to the segment, it can not be moved
+        // a running compactor could hold pages compressed while this controller already uses them
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    _mem_ptr = old._mem_ptr;
+    _shared = old._shared;
+    _replicas = old._replicas;
+    _reserved_size = old._reserved_size;
+    _min_address = old._min_address;
+    _size.store(old._size.load(std::memory_order_acquire), std::memory_order_relaxed);
+    _max_address.store(old._max_address.load(std::memory_order_acquire), std::memory_order_relaxed);
+    _guest_base = old._guest_base;
+    _endianness.store(old._endianness.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    uint32_t endian_count = old._endian_region_count.load(std::memory_order_acquire);
+    for(uint32_t i = 0; i < endian_count; i++) {
+        _endian_regions[i] = old._endian_regions[i];
+    }
+    _endian_region_count.store(endian_count, std::memory_order_release);
+    uint32_t file_count = old._file_region_count.load(std::memory_order_acquire);
+    for(uint32_t i = 0; i < file_count; i++) {
+        _file_regions[i] = old._file_regions[i];
+    }
+    _file_region_count.store(file_count, std::memory_order_release);
+    _read_only_regions.store(old._read_only_regions.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    _cpu.store(old._cpu.load(), std::memory_order_relaxed);
+    for(int i = 0; i < QUEUE_STATUS_BYTES; i++) {
+        channel->queue_status_bitarray[i] = 0;
+    }
+    if(old.running || old._joinable) {
+        // its stop() keeps the memory
+        old._handed_over.store(true, std::memory_order_release);
+    } else {
+        // stopped with free_memory = false: the memory belongs to us now
+        old._mem_ptr = nullptr;
+        old._memory_kept = false;
+    }
+#ifdef DEBUG
+    LOG_DEBUG("[MEMORY CONTROLLER]: took over the memory at guest base: "+std::to_string(_guest_base));
+#endif
+    return true;
+}
+
+bool Memory_Controller_Core::enable_code_watch() {
+    if(running || _mem_ptr == nullptr) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    return code_watch.init(_reserved_size);
+}
+
+bool Memory_Controller_Core::enable_compaction(uint32_t cold_passes, uint32_t scan_interval_ms) {
+    if(running || _shared || _mem_ptr == nullptr) {
+        // the shared memory pages can not be released with MADV_DONTNEED
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    if(!compactor.init(_reserved_size, cold_passes, scan_interval_ms)) {
+        return false;
+    }
+    compactor.set_limit(_size);
+    // file pages are dropped by the kernel anyway
+    for(uint32_t i = 0; i < _file_region_count; i++) {
+        compactor.exclude(_file_regions[i].start, _file_regions[i].end - _file_regions[i].start);
+    }
+    return true;
+}
+
+static uint64_t page_align_up(uint64_t value) {
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    return (value + page - 1) / page * page;
+}
+
+bool Memory_Controller_Core::resize(uint64_t new_size) {
+    uint64_t old_size = _size;
+    if(_shared || _mem_ptr == nullptr || new_size == 0 || new_size > _reserved_size) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    uint32_t count = _file_region_count.load(std::memory_order_acquire);
+    for(uint32_t i = 0; i < count; i++) {
+        if(_file_regions[i].end > new_size) {
+            // unmap the file first
+            SET_STANDARD_ERROR(UNDEFINED_ERROR);
+            return false;
+        }
+    }
+    uint64_t old_committed = page_align_up(old_size);
+    uint64_t new_committed = page_align_up(new_size);
+    if(new_committed > old_committed) {
+        // the pages have to be accessible before the controller uses the new bounds
+        if(mprotect(_mem_ptr + old_committed, new_committed - old_committed, PROT_READ | PROT_WRITE) == -1) {
+            SET_MEM_ERROR(ALLOC_ERROR);
+            return false;
+        }
+    }
+    if(running) {
+        // every request queued before the resize still uses the old bounds
+        queue_item in;
+        in.op = memory_ops::RESIZE;
+        in.data = new_size;
+        int index = add_to_input_queue(in);
+        if(index == -1) {
+            return false;
+        }
+        get_from_output_queue(index);
+        CATCH_ALL_MULTIPLE_ERROR(ALL_CRITICAL_ERRORS|ALL_MEMORY_ERRORS) {
+            return false;
+        }
+    } else {
+        set_size(new_size);
+    }
+    if(new_committed < old_committed) {
+        // the controller switched the bounds and the compactor limit -> nothing uses these pages anymore
+        // released by the calling thread: the controller does not pause for the madvise
+        madvise(_mem_ptr + new_committed, old_committed - new_committed, MADV_DONTNEED);
+        if(mprotect(_mem_ptr + new_committed, old_committed - new_committed, PROT_NONE) == -1) {
+            SET_MEM_ERROR(FREE_ERROR);
+            return false;
+        }
+    }
+#ifdef DEBUG
+    LOG_DEBUG("[MEMORY CONTROLLER]: resized from "+std::to_string(old_size)+" to "+std::to_string(new_size));
+#endif
+    return true;
+}
+
+void Memory_Controller_Core::set_size(uint64_t size) {
+    uint64_t old_committed = page_align_up(_size.load(std::memory_order_relaxed));
+    uint64_t new_committed = page_align_up(size);
+    _size.store(size, std::memory_order_release);
+    _max_address.store(_min_address + size, std::memory_order_release);
+    if(compactor.enabled()) {
+        if(new_committed < old_committed) {
+            // compressed data of released pages must not come back after growing again
+            compactor.discard(new_committed, old_committed - new_committed);
+        }
+        // the idle steps of this thread do not touch the released pages anymore
+        compactor.set_limit(size);
+    }
+}
+
+bool Memory_Controller_Core::map_file(uint64_t guest_address, const char* path, uint64_t file_offset, uint64_t length, file_mapping mode) {
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint32_t count = _file_region_count.load(std::memory_order_relaxed);
+    if(_mem_ptr == nullptr || _shared || count >= MAX_FILE_REGIONS || length == 0
+        || guest_address % page != 0 || file_offset % page != 0
+        || guest_address >= _size || length > _size - guest_address) {
+        // a shared memory segment can not contain a process local file mapping
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    if(running && compactor.enabled()) {
+        // the compactor could release a page of the new mapping before it sees the exclusion
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        if(guest_address < _file_regions[i].end && guest_address + length > _file_regions[i].start) {
+            SET_STANDARD_ERROR(UNDEFINED_ERROR);
+            return false;
+        }
+    }
+    // MAP_PRIVATE pages can be written without write access to the file
+    int fd = open(path, O_RDONLY);
+    if(fd == -1) {
+        SET_MEM_ERROR(ALLOC_ERROR);
+        return false;
+    }
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) == -1 || (uint64_t)file_stat.st_size <= file_offset) {
+        close(fd);
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    // a file backed page behind the end of the file raises SIGBUS on access:
+    // only the pages which contain file bytes are mapped, the rest of the region gets zero pages
+    uint64_t file_length = ((uint64_t)file_stat.st_size - file_offset + page - 1) / page * page;
+    if(file_length > length) {
+        file_length = length;
+    }
+    int prot = mode == file_mapping::READ_ONLY ? PROT_READ : PROT_READ | PROT_WRITE;
+    int flags = (mode == file_mapping::READ_ONLY ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED;
+    void* mem = mmap(_mem_ptr + guest_address, file_length, prot, flags, fd, file_offset);
+    close(fd);
+    if(mem != MAP_FAILED && file_length < length) {
+        mem = mmap(_mem_ptr + guest_address + file_length, length - file_length, prot,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    }
+    if(mem == MAP_FAILED) {
+        // the guest memory of the region is replaced by now -> give it back as zero pages
+        mmap(_mem_ptr + guest_address, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        SET_MEM_ERROR(ALLOC_ERROR);
+        return false;
+    }
+    if(compactor.enabled()) {
+        compactor.exclude(guest_address, length);
+    }
+    _file_regions[count].start = guest_address;
+    _file_regions[count].end = guest_address + length;
+    _file_regions[count].mode = mode;
+    if(mode == file_mapping::READ_ONLY) {
+        _read_only_regions.fetch_add(1, std::memory_order_relaxed);
+    }
+    // the controller sees the region after the entry is complete
+    _file_region_count.store(count + 1, std::memory_order_release);
+#ifdef DEBUG
+    LOG_DEBUG("[MEMORY CONTROLLER]: mapped file: "+std::string(path)+" at: "+std::to_string(guest_address)+" length: "+std::to_string(length));
+#endif
+    return true;
+}
+
+bool Memory_Controller_Core::unmap_file(uint64_t guest_address) {
+    uint32_t count = _file_region_count.load(std::memory_order_relaxed);
     if(running) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        if(_file_regions[i].start != guest_address) {
+            continue;
+        }
+        uint64_t length = _file_regions[i].end - _file_regions[i].start;
+        void* mem = mmap(_mem_ptr + guest_address, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if(mem == MAP_FAILED) {
+            SET_MEM_ERROR(ALLOC_ERROR);
+            return false;
+        }
+        if(_file_regions[i].mode == file_mapping::READ_ONLY) {
+            _read_only_regions.fetch_sub(1, std::memory_order_relaxed);
+        }
+        _file_regions[i] = _file_regions[count - 1];
+        _file_region_count.store(count - 1, std::memory_order_release);
+        return true;
+    }
+    SET_STANDARD_ERROR(UNDEFINED_ERROR);
+    return false;
+}
+
+void Memory_Controller_Core::set_endianness(endianness order) {
+    _endianness.store(order, std::memory_order_relaxed);
+}
+
+bool Memory_Controller_Core::add_endian_region(uint64_t address, uint64_t length, endianness order) {
+    uint32_t count = _endian_region_count.load(std::memory_order_relaxed);
+    if(count >= MAX_ENDIAN_REGIONS || length == 0 || address + length < address) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    _endian_regions[count].start = address;
+    _endian_regions[count].end = address + length;
+    _endian_regions[count].order = order;
+    // the controller sees the region after the entry is complete
+    _endian_region_count.store(count + 1, std::memory_order_release);
+    return true;
+}
+
+bool Memory_Controller_Core::is_read_only(uint64_t address, uint64_t size) {
+    uint32_t count = _file_region_count.load(std::memory_order_acquire);
+    for(uint32_t i = 0; i < count; i++) {
+        if(_file_regions[i].mode == file_mapping::READ_ONLY
+            && address < _file_regions[i].end && address + size > _file_regions[i].start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the controller of the calling thread, nullptr for producer threads
+static thread_local Memory_Controller_Core* current_controller = nullptr;
+
+void Memory_Controller_Core::start() {
+    if(running || _joinable) {
         return;
     }
     running = true;
+    _loop_exited.store(false, std::memory_order_relaxed);
 #ifdef DEBUG
     LOG_DEBUG("[MEMORY CONTROLLER]: Starting thread");
 #endif
 
-    pthread_create(&thread, NULL, thread_entry, this);
+    if(pthread_create(&thread, NULL, thread_entry, this) != 0) {
+        running = false;
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return;
+    }
+    _joinable = true;
 }
 
-void Memory_Controller_Core::set_affinity(int core_id) {
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);             // leeres Set
-    CPU_SET(core_id, &cpuset);     // gewünschten Core setzen
-
-    pthread_t thread = pthread_self();
-    int ret = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
-    if (ret != 0) {
-       std::cerr << "Fehler bei set_affinity: " << strerror(ret) << "\n";
-    } else {
-        std::cout << "Thread auf Core " << core_id << " gesetzt.\n";
-    }   
+bool Memory_Controller_Core::set_affinity(int core_id) {
+    _cpu = core_id;
+    if(!running) {
+        // thread_entry pins the thread on start
+        return true;
+    }
+    if(!CpuTopology::pin_thread(thread, core_id)) {
+        return false;
+    }
+#ifdef DEBUG
+    LOG_DEBUG("[MEMORY CONTROLLER]: thread pinned to cpu: "+std::to_string(core_id));
+#endif
+    return true;
 }
 
-void Memory_Controller_Core::stop() {
-    if(!running) {
+void Memory_Controller_Core::stop(bool free_memory) {
+    bool controller_thread = current_controller == this;
+    // only one caller frees the memory (the owner or the controller thread after an error)
+    bool was_running = running.exchange(false);
+    if(_joinable && !controller_thread) {
+        // the thread finishes the queued requests and leaves loop()
+        // -> the memory can not be unmapped under its feet
+        pthread_join(thread, NULL);
+        _joinable = false;
+    }
+    if(!was_running && !(free_memory && _memory_kept && _mem_ptr != nullptr)) {
         // thread alrdy exited and stopped by its own
+        // (only a controller stopped with free_memory = false before still has memory to free)
         return;
     }
+    _memory_kept = false;
 #ifdef DEBUG
     LOG_DEBUG("[MEMORY CONTROLLER]: Stopping thread");
 #endif
-    running = false;
+    if(_shared) {
+        // the memory belongs to the shared memory segment
+        channel->ready = false;
+        _mem_ptr = (uint8_t*)(0);
+        return;
+    }
+    if(_handed_over.load(std::memory_order_acquire) || !free_memory) {
+        // another controller goes on with the memory: the compressed pages have to be back
+        if(compactor.enabled()) {
+            compactor.release(_mem_ptr);
+        }
+        channel->ready = false;
+        if(_handed_over.load(std::memory_order_acquire)) {
+            _mem_ptr = (uint8_t*)(0);
+        } else {
+            _memory_kept = true;
+        }
+        return;
+    }
 #ifdef DEBUG
     LOG_DEBUG("[MEMORY CONTROLLER]: freeing memory");
 #endif
@@ -102,11 +460,25 @@ void Memory_Controller_Core::stop() {
 
 // this functions will run in a separate thread
 void Memory_Controller_Core::loop() {
-    ready = true;
+    // producers in other processes check that this process is still alive
+    channel->controller_pid.store(getpid(), std::memory_order_release);
+    channel->ready = true;
     queue_item* in;
-    while(running) {
+    while(true) {
         
         if(!get_from_input_queue(in)) {
+            if(!running.load(std::memory_order_acquire)) {
+                // stop(): every request queued before is done
+                break;
+            }
+            Memory_Controller_Core* predecessor = _predecessor.load(std::memory_order_acquire);
+            if(predecessor != nullptr && predecessor->_loop_exited.load(std::memory_order_acquire)) {
+                // the handover is done, replace_controller can delete the old controller
+                _predecessor.store(nullptr, std::memory_order_release);
+            }
+            if(compactor.enabled()) {
+                compactor.idle_step(_mem_ptr, &channel->reqs);
+            }
             continue;
         }
 #ifdef CONTROLLER_DEBUG
@@ -119,6 +491,40 @@ void Memory_Controller_Core::loop() {
             last_operation = in->op;
 
 #endif         
+        if(_predecessor.load(std::memory_order_relaxed) != nullptr && !wait_for_predecessor()) {
+            return;
+        }
+        // the slot can be reused by the producer as soon as the status is reset
+        uint64_t address = in->address;
+        if(in->op == memory_ops::RESIZE) {
+            // all following requests use the new bounds
+            set_size(in->data);
+            add_to_output_queue(in->data, in->slot);
+            continue;
+        }
+        if(in->op == memory_ops::GATHER || in->op == memory_ops::SCATTER) {
+            if(!vector_access(in)) {
+                return;
+            }
+            continue;
+        }
+        uint64_t size = _size.load(std::memory_order_relaxed);
+        if(address >= size || in->size > size - address) {
+            // e.g. an access behind a shrunk memory
+            SET_MEM_ERROR(BOUNDARY_ERROR);
+#ifdef DEBUG
+            LOG_DEBUG("[MEMORY CONTROLLER]: access out of bounds: "+std::to_string(address));
+#endif
+            return;
+        }
+        if(compactor.enabled()) {
+            // decompresses the page if needed
+            compactor.touch(_mem_ptr, address, in->size);
+        }
+        if(watchpoints.armed()) {
+            // reported before the status changes -> the producer sees it with the result
+            in->watchpoint = watchpoints.check(address, in->size, in->op == memory_ops::READ ? WATCH_READ : WATCH_WRITE);
+        }
         switch(in->op) {
                 case memory_ops::READ:  {
 #ifdef CONTROLLER_DEBUG
@@ -141,13 +547,20 @@ void Memory_Controller_Core::loop() {
 #ifdef DEBUG
             LOG_DEBUG("[MEMORY CONTROLLER]: extraced item from queue slot: "+std::to_string(in->slot)+" -> Write operation");
 #endif  
-                    set_item(_mem_ptr, in->address, in->data, in->size);
+                    store_item(address, in->data, in->size);
                     // here we dont need to add anything to the output queue
                     // but we need to reset the queue status
-                    queue_status_bitarray[in->slot].store(0, std::memory_order_release);
+                    channel->queue_status_bitarray[in->slot].store(0, std::memory_order_release);
+                    break;
+                }
+                default: {
+                    // RESIZE/GATHER/SCATTER are handled above
                     break;
                 }
         }
+        if(prefetcher.enabled()) {
+            prefetcher.access(_mem_ptr, size, address);
+        }
         CATCH_ALL_MULTIPLE_ERROR(ALL_CRITICAL_ERRORS|ALL_MEMORY_ERRORS) {
 #ifdef DEBUG
             LOG_DEBUG("[MEMORY CONTROLLER]: Stopping Controller");
@@ -162,12 +575,24 @@ void Memory_Controller_Core::loop() {
 
 void* thread_entry(void* arg) {
     Memory_Controller_Core* core = (Memory_Controller_Core*)arg;
-    //core->set_affinity(1);
+    current_controller = core;
+    if(core->_cpu >= 0) {
+        // pthread_create might not have written core->thread yet
+        CpuTopology::pin_current_thread(core->_cpu);
+    }
 #ifdef DEBUG
     LOG_DEBUG("[MEMORY CONTROLLER]: thread started");
 #endif
+    // the controller of a crashed process leaves the lock "owner dead"
+    if(pthread_mutex_lock(&core->channel->alive_lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&core->channel->alive_lock);
+    }
     core->loop();
+    pthread_mutex_unlock(&core->channel->alive_lock);
+    core->_loop_exited.store(true, std::memory_order_release);
     CATCH_ALL_MULTIPLE_ERROR(ALL_CRITICAL_ERRORS|ALL_MEMORY_ERRORS) {
+        // producers in other processes dont see our error register
+        core->channel->controller_error.store(error_reg, std::memory_order_release);
 #ifdef DEBUG
         core->debug_errors();
 #endif
@@ -179,16 +604,40 @@ void* thread_entry(void* arg) {
     return NULL;
 }
 
-int Memory_Controller_Core::add_to_input_queue(queue_item in) {
+int Memory_Controller_Core::add_to_input_queue(queue_item in, const vector_request* vector) {
+    int index = try_add_to_input_queue(in, vector);
+    if(index == -1) {
+#ifdef DEBUG
+        LOG_DEBUG("[MEMORY CONTROLLER]: all slots are full");
+#endif
+        SET_MEM_ERROR(QUEUE_IS_FULL);
+        // BIG F if we get here
+    }
+    return index;
+}
+
+bool Memory_Controller_Core::has_free_slot() {
+    for(uint64_t i = 0; i < QUEUE_SLOTS; i++) {
+        if(channel->queue_status_bitarray[i].load(std::memory_order_acquire) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int Memory_Controller_Core::try_add_to_input_queue(queue_item in, const vector_request* vector) {
     for(uint64_t i = 0; i < QUEUE_SLOTS; i++) {
         uint8_t expected = 0;
-        if (queue_status_bitarray[i].compare_exchange_strong(expected, 1)) {
+        if (channel->queue_status_bitarray[i].compare_exchange_strong(expected, 1)) {
             in.slot = i;
-            queue[i] = in;
-            queue_status_bitarray[i].store(2, std::memory_order_release);
-            if(!reqs.producer_push(&queue[i])) {
-                SET_MEM_ERROR(QUEUE_IS_FULL);
-                queue_status_bitarray[i].store(0, std::memory_order_release);
+            in.watchpoint = 0;
+            channel->queue[i] = in;
+            if(vector != nullptr) {
+                channel->vectors[i] = *vector;
+            }
+            channel->queue_status_bitarray[i].store(2, std::memory_order_release);
+            if(!channel->reqs.producer_push((uint8_t)i)) {
+                channel->queue_status_bitarray[i].store(0, std::memory_order_release);
                 return -1;    
             }
 #ifdef CONTROLLER_DEBUG
@@ -200,24 +649,138 @@ int Memory_Controller_Core::add_to_input_queue(queue_item in) {
             return i;
         }
     }
-#ifdef DEBUG
-    LOG_DEBUG("[MEMORY CONTROLLER]: all slots are full");
-#endif
-    SET_MEM_ERROR(QUEUE_IS_FULL);
-    // BIG F if we get here
     return -1;
 }
 
+int Memory_Controller_Core::add_gather(uint64_t base, const int64_t* indices, uint32_t count, uint8_t scale, uint16_t element_size, uint32_t mask) {
+    if(count == 0 || count > MAX_VECTOR_ELEMENTS || element_size == 0 || element_size > 8) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return -1;
+    }
+    vector_request vector;
+    for(uint32_t i = 0; i < count; i++) {
+        vector.offsets[i] = indices[i] * scale;
+    }
+    vector.count = count;
+    vector.mask = mask;
+    queue_item in;
+    in.op = memory_ops::GATHER;
+    in.address = base;
+    in.size = element_size;
+    in.data = count;
+    return add_to_input_queue(in, &vector);
+}
+
+int Memory_Controller_Core::add_scatter(uint64_t base, const int64_t* indices, const uint64_t* values, uint32_t count, uint8_t scale, uint16_t element_size, uint32_t mask) {
+    if(count == 0 || count > MAX_VECTOR_ELEMENTS || element_size == 0 || element_size > 8) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return -1;
+    }
+    vector_request vector;
+    for(uint32_t i = 0; i < count; i++) {
+        vector.offsets[i] = indices[i] * scale;
+        vector.data[i] = values[i];
+    }
+    vector.count = count;
+    vector.mask = mask;
+    queue_item in;
+    in.op = memory_ops::SCATTER;
+    in.address = base;
+    in.size = element_size;
+    in.data = count;
+    return add_to_input_queue(in, &vector);
+}
+
+bool Memory_Controller_Core::get_gather_result(uint64_t index, uint64_t* out) {
+    // the slot is free after this, but only this producer can reserve it again
+    uint64_t count = get_from_output_queue(index);
+    CATCH_ALL_MULTIPLE_ERROR(ALL_CRITICAL_ERRORS|ALL_MEMORY_ERRORS) {
+        return false;
+    }
+    memcpy(out, channel->vectors[index].data, count * sizeof(uint64_t));
+    return true;
+}
+
+bool Memory_Controller_Core::is_output_ready(uint64_t index) {
+    return channel->queue_status_bitarray[index].load(std::memory_order_acquire) == 3;
+}
+
+uint64_t Memory_Controller_Core::completion_mask() {
+    static_assert(sizeof(std::atomic<uint8_t>) == 1, "status bytes need to be packed");
+    static_assert(QUEUE_STATUS_BYTES % 16 == 0, "the scan loads whole 16 byte vectors");
+    // the status bytes are read with atomic 8 byte loads (aligned -> not torn, not hoisted out
+    // of polling loops) and compared in vector registers
+    uint64_t* words = (uint64_t*)channel->queue_status_bitarray;
+    uint64_t mask = 0;
+#ifdef __AVX2__
+    const __m256i out_ready = _mm256_set1_epi8(3);
+    int i = 0;
+    for(; i + 32 <= QUEUE_STATUS_BYTES; i += 32) {
+        __m256i bytes = _mm256_set_epi64x(
+            (int64_t)std::atomic_ref<uint64_t>(words[i / 8 + 3]).load(std::memory_order_relaxed),
+            (int64_t)std::atomic_ref<uint64_t>(words[i / 8 + 2]).load(std::memory_order_relaxed),
+            (int64_t)std::atomic_ref<uint64_t>(words[i / 8 + 1]).load(std::memory_order_relaxed),
+            (int64_t)std::atomic_ref<uint64_t>(words[i / 8]).load(std::memory_order_relaxed));
+        mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, out_ready)) << i;
+    }
+    if(i < QUEUE_STATUS_BYTES) {
+        __m128i bytes = _mm_set_epi64x(
+            (int64_t)std::atomic_ref<uint64_t>(words[i / 8 + 1]).load(std::memory_order_relaxed),
+            (int64_t)std::atomic_ref<uint64_t>(words[i / 8]).load(std::memory_order_relaxed));
+        mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(3))) << i;
+    }
+#else
+    const __m128i out_ready = _mm_set1_epi8(3);
+    for(int i = 0; i < QUEUE_STATUS_BYTES; i += 16) {
+        __m128i bytes = _mm_set_epi64x(
+            (int64_t)std::atomic_ref<uint64_t>(words[i / 8 + 1]).load(std::memory_order_relaxed),
+            (int64_t)std::atomic_ref<uint64_t>(words[i / 8]).load(std::memory_order_relaxed));
+        mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, out_ready)) << i;
+    }
+#endif
+    // the results in the slots are read after the scan
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return mask;
+}
+
+void Memory_Controller_Core::enable_completion_ring(bool enable) {
+    channel->completion_ring_enabled.store(enable, std::memory_order_release);
+}
+
+uint64_t Memory_Controller_Core::completion_ring_overflows() {
+    return channel->completion_overflows.load(std::memory_order_acquire);
+}
+
+size_t Memory_Controller_Core::drain_completions(uint64_t* out, size_t max) {
+    size_t count = 0;
+    uint8_t slot;
+    while(count < max && channel->completions.consumer_pop(&slot)) {
+        // a slot harvested and reused without the ring would show up twice
+        if(channel->queue_status_bitarray[slot].load(std::memory_order_acquire) != 3) {
+            continue;
+        }
+        out[count] = slot;
+        count++;
+    }
+    return count;
+}
+
 void Memory_Controller_Core::add_to_output_queue(uint64_t out, uint64_t index) {
 #ifdef CONTROLLER_DEBUG
     std::cerr << "Resolving request: slot: " << index << " data: " << out << std::endl;
 #endif
-    queue[index].data = out;
+    channel->queue[index].data = out;
 #ifdef CONTROLLER_DEBUG
     std::cout << "PRE STATE ADD TO OUTPUT: " << std::endl;
     debug_queue_bits(index);
 #endif
-    queue_status_bitarray[index].store(3, std::memory_order_release);
+    channel->queue_status_bitarray[index].store(3, std::memory_order_release);
+    if(channel->completion_ring_enabled.load(std::memory_order_relaxed)) {
+        if(!channel->completions.producer_push((uint8_t)index)) {
+            // the completion is still visible in the status byte -> the producer has to scan once
+            channel->completion_overflows.store(channel->completion_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    }
 #ifdef CONTROLLER_DEBUG
     std::cout << "AFTER STATE ADD TO OUTPUT: " << std::endl;
     debug_queue_bits(index);
@@ -225,11 +788,11 @@ void Memory_Controller_Core::add_to_output_queue(uint64_t out, uint64_t index) {
 }
 
 bool Memory_Controller_Core::get_from_input_queue(queue_item*& in) {
-    queue_item* ptr = nullptr;
-    if(!reqs.consumer_pop(&ptr)) {
+    uint8_t slot;
+    if(!channel->reqs.consumer_pop(&slot)) {
         return false;
     }
-   in = ptr;
+   in = &channel->queue[slot];
 #ifdef DEBUG
         LOG_DEBUG("Item: address: "+std::to_string(in->address)+" data: "+std::to_string(in->data)+" operation: "+std::to_string(in->op)+" slot: "+std::to_string(in->slot));
 #endif
@@ -244,20 +807,34 @@ uint64_t Memory_Controller_Core::get_from_output_queue(uint64_t index) {
 #endif
             return 0;
         }
-    while(queue_status_bitarray[index].load(std::memory_order_acquire) != 3) {
+    uint64_t spins = 0;
+    while(channel->queue_status_bitarray[index].load(std::memory_order_acquire) != 3) {
         CATCH_ALL_MULTIPLE_ERROR(ALL_CRITICAL_ERRORS|ALL_MEMORY_ERRORS){
 #ifdef DEBUG
             LOG_DEBUG("[PRODUCER]: leaving waitloop -> Error occured");
 #endif
             return 0;
         }
+        if(_shared) {
+            uint64_t controller_error = channel->controller_error.load(std::memory_order_acquire);
+            if(controller_error) {
+#ifdef DEBUG
+                LOG_DEBUG("[PRODUCER]: leaving waitloop -> controller process had error");
+#endif
+                SET_MULTIPLE_ERROR(controller_error);
+                return 0;
+            }
+            if(++spins % LIVENESS_CHECK_SPINS == 0 && controller_lost()) {
+                return 0;
+            }
+        }
     }
-    uint64_t out = queue[index].data;
+    uint64_t out = channel->queue[index].data;
 #ifdef CONTROLLER_DEBUG
     std::cout << "PRE STATE GET FROM OUTPUT: " << std::endl;
     debug_queue_bits(index);
 #endif
-    queue_status_bitarray[index].store(0, std::memory_order_release);
+    channel->queue_status_bitarray[index].store(0, std::memory_order_release);
 #ifdef CONTROLLER_DEBUG
     std::cout << "AFTER STATE GET FROM OUTPUT: " << std::endl;
     debug_queue_bits(index);
@@ -265,24 +842,126 @@ uint64_t Memory_Controller_Core::get_from_output_queue(uint64_t index) {
     return out;
 }
 
+void Memory_Controller_Core::wait_for_write(uint64_t index) {
+    wait_for_slot(index, false);
+}
+
+void Memory_Controller_Core::flush_writes() {
+    // the queue is processed in order, a slot reserved later can not be done before these
+    for(uint64_t index = 0; index < QUEUE_SLOTS; index++) {
+        uint8_t status = channel->queue_status_bitarray[index].load(std::memory_order_acquire);
+        if(status == 1 || status == 2) {
+            wait_for_slot(index, true);
+        }
+    }
+}
+
+bool Memory_Controller_Core::wait_for_predecessor() {
+    Memory_Controller_Core* predecessor = _predecessor.load(std::memory_order_acquire);
+    // the producer queued everything on the predecessor before this request (program order)
+    // -> it is done when no slot is reserved or waiting anymore
+    for(uint64_t index = 0; index < QUEUE_SLOTS; index++) {
+        while(!predecessor->_loop_exited.load(std::memory_order_acquire)) {
+            uint8_t status = predecessor->channel->queue_status_bitarray[index].load(std::memory_order_acquire);
+            if(status != 1 && status != 2) {
+                break;
+            }
+            CATCH_ALL_MULTIPLE_ERROR(ALL_CRITICAL_ERRORS|ALL_MEMORY_ERRORS) {
+                return false;
+            }
+            _mm_pause();
+        }
+    }
+    _predecessor.store(nullptr, std::memory_order_release);
+#ifdef DEBUG
+    LOG_DEBUG("[MEMORY CONTROLLER]: predecessor drained, handover done");
+#endif
+    return true;
+}
+
+void Memory_Controller_Core::wait_for_slot(uint64_t index, bool until_output) {
+    // only this producer can reserve the slot again
+    uint64_t spins = 0;
+    uint8_t status;
+    while((status = channel->queue_status_bitarray[index].load(std::memory_order_acquire)) != 0
+          && !(until_output && status == 3)) {
+        CATCH_ALL_MULTIPLE_ERROR(ALL_CRITICAL_ERRORS|ALL_MEMORY_ERRORS){
+            return;
+        }
+        if(_shared && channel->controller_error.load(std::memory_order_acquire)) {
+            SET_MULTIPLE_ERROR(channel->controller_error.load(std::memory_order_acquire));
+            return;
+        }
+        if(_shared && ++spins % LIVENESS_CHECK_SPINS == 0 && controller_lost()) {
+            return;
+        }
+    }
+}
+
+bool Memory_Controller_Core::controller_lost() {
+    int32_t pid = channel->controller_pid.load(std::memory_order_acquire);
+    if(pid == 0) {
+        // not started yet
+        return false;
+    }
+    // a stopped controller clears ready after the queued requests are done
+    // a killed one leaves ready set, but the kernel released its alive_lock
+    if(channel->ready.load(std::memory_order_acquire)) {
+        int result = pthread_mutex_trylock(&channel->alive_lock);
+        if(result == EBUSY) {
+            return false;
+        }
+        if(result == EOWNERDEAD) {
+            // usable again for the next controller
+            pthread_mutex_consistent(&channel->alive_lock);
+        }
+        if(result == 0 || result == EOWNERDEAD) {
+            pthread_mutex_unlock(&channel->alive_lock);
+        }
+    }
+#ifdef DEBUG
+    LOG_DEBUG("[PRODUCER]: leaving waitloop -> controller process "+std::to_string(pid)+" is gone");
+#endif
+    SET_MULTIPLE_ERROR((uint64_t)CONTROLLER_LOST|FAST_EXIT);
+    return true;
+}
+
+uint32_t Memory_Controller_Core::get_watchpoint_hit(uint64_t index) {
+    return channel->queue[index].watchpoint;
+}
+
 void Memory_Controller_Core::wait_for_controller_to_start() {
-    while(!ready) {
+    while(!channel->ready) {
         usleep(10);
     }
 }
 
 // Engine Functions:
 // Initialize memory with mmap
-uint8_t* Memory_Controller_Core::init_mem(uint64_t size) {
-    void* mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+uint8_t* Memory_Controller_Core::init_mem(uint64_t size, uint64_t reserve) {
+    if(reserve < size) {
+        reserve = size;
+    }
+    void* mem;
+    if(reserve == size) {
+        mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    } else {
+        // only address space is reserved, resize() makes the pages accessible
+        mem = mmap(0, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(mem != MAP_FAILED && mprotect(mem, page_align_up(size), PROT_READ | PROT_WRITE) == -1) {
+            munmap(mem, reserve);
+            mem = MAP_FAILED;
+        }
+    }
     if(mem == MAP_FAILED) {
         // set the error register
-        SET_MULTIPLE_ERROR(ALLOC_ERROR+FAST_EXIT);
+        SET_MULTIPLE_ERROR((uint64_t)ALLOC_ERROR+FAST_EXIT);
         return 0;
     }
     _max_address = (uint64_t)mem+size;
     _min_address = (uint64_t)mem;
     _size = size;
+    _reserved_size = reserve;
     return (uint8_t*)mem;
 }
 
@@ -290,160 +969,204 @@ void Memory_Controller_Core::free_mem(uint8_t* mem) {
     // this part is critical, beacuse the user needs to make sure that the memory is valid
     if(mem == 0) {
         // set the error register
-        SET_MULTIPLE_ERROR(FREE_ERROR|FAST_EXIT);
+        SET_MULTIPLE_ERROR((uint64_t)FREE_ERROR|FAST_EXIT);
         return;
     }
     // check if the memory is valid
     // unmap the memory
-    if(munmap((void*)(mem), _size) == -1) {
-        SET_MULTIPLE_ERROR(FREE_ERROR+FAST_EXIT);
+    if(munmap((void*)(mem), _reserved_size) == -1) {
+        SET_MULTIPLE_ERROR((uint64_t)FREE_ERROR+FAST_EXIT);
         return;
     }
 }
 
-// make sure to give a correct memory pointer in the function!!!
-uint64_t Memory_Controller_Core::get_item(uint8_t* mem, uint64_t in_address, uint16_t size) {
-    // extract the max and min address from the memory
-    uint64_t data = 0;
-    uint64_t address = in_address+(uint64_t)_min_address; // add the pointer address -> begin of the data area to the in_address so we get the real address
+void Memory_Controller_Core::store_item(uint64_t address, uint64_t data, uint16_t size) {
+    if(_read_only_regions.load(std::memory_order_relaxed) && is_read_only(address, size)) {
+        // ROM: the write is dropped like on the real hardware
+        ignored_rom_writes.store(ignored_rom_writes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    if(_replicas != nullptr) {
+        // keep all NUMA replicas equal: without the lock two controllers could
+        // write the same address in a different order into different replicas
+        _replicas->lock_writes();
+        for(uint32_t i = 0; i < _replicas->count(); i++) {
+            set_item(_replicas->get(i), address, data, size);
+        }
+        _replicas->unlock_writes();
+    } else {
+        set_item(_mem_ptr, address, data, size);
+    }
+    if(code_watch.active()) {
+        // self modifying code -> tell the JIT
+        code_watch.on_write(address, size);
+    }
+}
+
+bool Memory_Controller_Core::vector_access(queue_item* in) {
+    vector_request* vector = &channel->vectors[in->slot];
+    uint64_t base = in->address;
+    uint16_t element_size = in->size;
+    uint32_t count = vector->count > MAX_VECTOR_ELEMENTS ? MAX_VECTOR_ELEMENTS : vector->count;
+    uint32_t active = vector->mask & (uint32_t)((1ULL << count) - 1);
+    uint64_t size = _size.load(std::memory_order_relaxed);
+    // all lanes are checked before the first access -> a faulting request changes nothing
+    for(uint32_t i = 0; i < count; i++) {
+        if(!(active & (1U << i))) {
+            continue;
+        }
+        uint64_t address = base + (uint64_t)vector->offsets[i];
+        if(address >= size || element_size > size - address) {
+            SET_MEM_ERROR(BOUNDARY_ERROR);
 #ifdef DEBUG
-    LOG_DEBUG("[MEMORY CONTROLLER]: Reading on address: "+std::to_string(address)+" data: "+std::to_string(data)+" size: "+std::to_string(size));
-    LOG_DEBUG("[MEMORY CONTROLLER]: min_address: "+std::to_string(_min_address)+" max adress: "+std::to_string(_max_address));
-    LOG_DEBUG("[MEMORY CONTROLLER]: ptr_address: "+std::to_string((uint64_t)_mem_ptr)+" in_address: "+std::to_string(in_address));
+            LOG_DEBUG("[MEMORY CONTROLLER]: vector lane out of bounds: "+std::to_string(address));
 #endif
-        // address is in range
-#ifdef IS_BIG_ENDIAN
-        // BIG ENDIAN READ
-        // here we will read byte after byte until we reach the given size
-        int i = 0;
-        switch(size) {
-            case 8: {
-                data = *(uint64_t*)address;
-                return data;
-                break;
-            }
-            case 4: {
-                data = *(uint32_t*)address;
-                return data;
-                break;                
-            }
-            case 2: {
-                data = *(uint16_t*)address;
-                return data;
-                break;                      
-            }
-            default: {
-                do {
-                    data |= (*(uint8_t*)(address + size - 1 - i) << (i * 8));
-                    i++;
-                }while(i < size);
-                return data;
-                break;
-            }
+            return false;
         }
-        return data;
-#endif
-#ifdef IS_LITTLE_ENDIAN
-        // LITTLE ENDIAN READ
-        // here we will read byte after byte until we reach the given size
-        int i = 0;
-        switch(size) {
-            case 8: {
-                data = *(uint64_t*)address;
-                return data;
-                break;
-            }
-            case 4: {
-                data = *(uint32_t*)address;
-                return data;
-                break;                
-            }
-            case 2: {
-                data = *(uint16_t*)address;
-                return data;
-                break;                      
+        if(compactor.enabled()) {
+            compactor.touch(_mem_ptr, address, element_size);
+        }
+        if(watchpoints.armed() && in->watchpoint == 0) {
+            in->watchpoint = watchpoints.check(address, element_size, in->op == memory_ops::GATHER ? WATCH_READ : WATCH_WRITE);
+        }
+    }
+    if(in->op == memory_ops::SCATTER) {
+        // lanes are written in order, the last lane wins on overlapping addresses
+        for(uint32_t i = 0; i < count; i++) {
+            if(active & (1U << i)) {
+                store_item(base + (uint64_t)vector->offsets[i], vector->data[i], element_size);
             }
-            default: {
-                do {
-                    data |= ((uint64_t)(*(uint8_t*)(address + i)) << (i * 8));
-                    i++;
-                }while(i < size);
-                return data;
-                break;
+        }
+        channel->queue_status_bitarray[in->slot].store(0, std::memory_order_release);
+        return true;
+    }
+#ifdef __AVX2__
+    if((element_size == 8 || element_size == 4) && _endian_region_count.load(std::memory_order_acquire) == 0) {
+        // host gather: 4 lanes per instruction, inactive lanes are not loaded
+        const uint8_t* mem = _mem_ptr + base;
+        // big endian: the byte swap of all lanes is one shuffle
+        bool big = _endianness.load(std::memory_order_relaxed) == endianness::BIG;
+        const __m256i swap64 = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+                                               8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+        const __m128i swap32 = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+        for(uint32_t i = 0; i < count; i += 4) {
+            uint32_t bits = active >> i;
+            __m256i offsets = _mm256_load_si256((const __m256i*)&vector->offsets[i]);
+            if(element_size == 8) {
+                __m256i lanes = _mm256_set_epi64x(-(int64_t)((bits >> 3) & 1), -(int64_t)((bits >> 2) & 1),
+                                                  -(int64_t)((bits >> 1) & 1), -(int64_t)(bits & 1));
+                __m256i data = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), (const long long*)mem, offsets, lanes, 1);
+                if(big) {
+                    data = _mm256_shuffle_epi8(data, swap64);
+                }
+                _mm256_store_si256((__m256i*)&vector->data[i], data);
+            } else {
+                __m128i lanes = _mm_set_epi32(-(int32_t)((bits >> 3) & 1), -(int32_t)((bits >> 2) & 1),
+                                              -(int32_t)((bits >> 1) & 1), -(int32_t)(bits & 1));
+                __m128i data = _mm256_mask_i64gather_epi32(_mm_setzero_si128(), (const int*)mem, offsets, lanes, 1);
+                if(big) {
+                    data = _mm_shuffle_epi8(data, swap32);
+                }
+                _mm256_store_si256((__m256i*)&vector->data[i], _mm256_cvtepu32_epi64(data));
             }
         }
-#ifdef CONTROLLER_DEBUG
-        std::cout << "Reading on address:" << address << " data read: " << data << " size:" << size << std::endl;          
-#endif
-        return data;
+        add_to_output_queue(count, in->slot);
+        return true;
+    }
 #endif
+    for(uint32_t i = 0; i < count; i++) {
+        vector->data[i] = (active & (1U << i)) ? get_item(_mem_ptr, base + (uint64_t)vector->offsets[i], element_size) : 0;
+    }
+    add_to_output_queue(count, in->slot);
+    return true;
+}
 
-    return 0;
+// guest access kernels:
+// every size is done with at most two overlapping loads/stores, no byte loops
+// the bytes are always in guest memory order (host little endian), the swap for big endian is done on top
+static inline uint64_t load_bytes(const uint8_t* ptr, uint16_t size) {
+    if(size == 8) {
+        uint64_t value;
+        memcpy(&value, ptr, 8);
+        return value;
+    }
+    if(size >= 4) {
+        // 5..7 bytes: the two loads overlap, the overlapping bytes are equal
+        uint32_t low, high;
+        memcpy(&low, ptr, 4);
+        memcpy(&high, ptr + size - 4, 4);
+        return (uint64_t)low | ((uint64_t)high << ((size - 4) * 8));
+    }
+    if(size >= 2) {
+        uint16_t low, high;
+        memcpy(&low, ptr, 2);
+        memcpy(&high, ptr + size - 2, 2);
+        return (uint64_t)low | ((uint64_t)high << ((size - 2) * 8));
+    }
+    return *ptr;
 }
 
-void Memory_Controller_Core::set_item(uint8_t* mem, uint64_t in_address, uint64_t data, uint16_t size) {
-    uint64_t address = in_address+(uint64_t)_mem_ptr; // add the pointer address -> begin of the data area to the in_address so we get the real address
+static inline void store_bytes(uint8_t* ptr, uint64_t value, uint16_t size) {
+    if(size == 8) {
+        memcpy(ptr, &value, 8);
+        return;
+    }
+    if(size >= 4) {
+        uint32_t high = (uint32_t)(value >> ((size - 4) * 8));
+        uint32_t low = (uint32_t)value;
+        memcpy(ptr + size - 4, &high, 4);
+        memcpy(ptr, &low, 4);
+        return;
+    }
+    if(size >= 2) {
+        uint16_t high = (uint16_t)(value >> ((size - 2) * 8));
+        uint16_t low = (uint16_t)value;
+        memcpy(ptr + size - 2, &high, 2);
+        memcpy(ptr, &low, 2);
+        return;
+    }
+    *ptr = (uint8_t)value;
+}
+
+// reverses the lower size bytes (size 1..8)
+static inline uint64_t swap_bytes(uint64_t value, uint16_t size) {
+    return __builtin_bswap64(value) >> (64 - size * 8);
+}
+
+// make sure to give a correct memory pointer in the function!!!
+uint64_t Memory_Controller_Core::get_item(uint8_t* mem, uint64_t in_address, uint16_t size) {
+    uint8_t* address = mem + in_address; // add the pointer address -> begin of the data area to the in_address so we get the real address
 #ifdef DEBUG
-    LOG_DEBUG("[MEMORY CONTROLLER]: Writing on address: "+std::to_string(address)+" data: "+std::to_string(data)+" size: "+std::to_string(size));
+    LOG_DEBUG("[MEMORY CONTROLLER]: Reading on address: "+std::to_string((uint64_t)address)+" size: "+std::to_string(size));
     LOG_DEBUG("[MEMORY CONTROLLER]: min_address: "+std::to_string(_min_address)+" max adress: "+std::to_string(_max_address));
     LOG_DEBUG("[MEMORY CONTROLLER]: ptr_address: "+std::to_string((uint64_t)_mem_ptr)+" in_address: "+std::to_string(in_address));
 #endif
-#ifdef IS_BIG_ENDIAN
-        // BIG ENDIAN WRITE
-        // here we will write byte after byte until we reach the given size
-        int i = 0;
-        switch(size) {
-            case 8: {
-                *(uint64_t*)address = data;
-                return;
-                break;
-            }
-            case 4: {
-                *(uint32_t*)address = data;
-                return;
-                break;
-            }
-            case 2: {
-                *(uint16_t*)address = data;
-                return;
-                break;
-            }
-            default: {
-                do{
-                    *(uint8_t*)(address +size -1 - i) = (data >> (i * 8)) & 0xFF;
-                    i++;
-                }while(i < size);
-            }
-        }
-        return;
+    if(size == 0 || size > 8) {
+        SET_MEM_ERROR(READ_ERROR);
+        return 0;
+    }
+    uint64_t data = load_bytes(address, size);
+    // both values are computed -> the selection is a cmov and not a branch
+    uint64_t swapped = swap_bytes(data, size);
+    data = endianness_of(in_address) == endianness::BIG ? swapped : data;
+#ifdef CONTROLLER_DEBUG
+    std::cout << "Reading on address:" << (uint64_t)address << " data read: " << data << " size:" << size << std::endl;
 #endif
-#ifdef IS_LITTLE_ENDIAN
-        int i = 0;
-        switch(size) {
-            case 8: {
-                *(uint64_t*)address = data;
-                return;
-                break;
-            }
-            case 4: {
-                *(uint32_t*)address = data;
-                return;
-                break;
-            }
-            case 2: {
-                *(uint16_t*)address = data;
-                return;
-                break;
-            }
-            default: {
-                do{
-                    *(uint8_t*)(address + i) = (data >> (i * 8)) & 0xFF;
-                    i++;
-                }while(i < size);
-            }
-        }
-        // LITTLE ENDIAN WRITE
-        // here we will write byte after byte until we reach the given size
-        return;
+    return data;
+}
+
+void Memory_Controller_Core::set_item(uint8_t* mem, uint64_t in_address, uint64_t data, uint16_t size) {
+    uint8_t* address = mem + in_address; // add the pointer address -> begin of the data area to the in_address so we get the real address
+#ifdef DEBUG
+    LOG_DEBUG("[MEMORY CONTROLLER]: Writing on address: "+std::to_string((uint64_t)address)+" data: "+std::to_string(data)+" size: "+std::to_string(size));
+    LOG_DEBUG("[MEMORY CONTROLLER]: min_address: "+std::to_string(_min_address)+" max adress: "+std::to_string(_max_address));
+    LOG_DEBUG("[MEMORY CONTROLLER]: ptr_address: "+std::to_string((uint64_t)_mem_ptr)+" in_address: "+std::to_string(in_address));
 #endif
-}
\ No newline at end of file
+    if(size == 0 || size > 8) {
+        SET_MEM_ERROR(WRITE_ERROR);
+        return;
+    }
+    uint64_t swapped = swap_bytes(data, size);
+    data = endianness_of(in_address) == endianness::BIG ? swapped : data;
+    store_bytes(address, data, size);
+}
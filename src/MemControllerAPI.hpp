@@ -11,6 +11,11 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include "RingBuffer_QueueItems.hpp"
+#include "CpuTopology.hpp"
+#include "StreamPrefetcher.hpp"
+#include "PageCompactor.hpp"
+#include "CodeWatch.hpp"
+#include "Watchpoints.hpp"
 #include <thread>
 #ifdef DEBUG
 #include "Logger.hpp"
@@ -50,16 +55,99 @@
 // 0000 0010 bit for write
 // 0000 0100 bit for output ready
 #define QUEUE_SLOTS 10 
+// the status bytes are padded to whole 16 byte vectors for the completion scan
+// QUEUE_SLOTS <= 64 keeps all status bytes in one cacheline
+#define QUEUE_STATUS_BYTES (((QUEUE_SLOTS + 15) / 16) * 16)
+static_assert(QUEUE_SLOTS <= 64, "completion mask is 64 bit wide");
+static_assert(QUEUE_SLOTS <= 256, "the rings store slot indices as uint8_t");
+// waiting producers of a shared channel check the controller process every LIVENESS_CHECK_SPINS spins
+#define LIVENESS_CHECK_SPINS (1 << 16)
 
+// lanes of a GATHER/SCATTER request, one per queue slot
+// guest address of lane i: base (queue_item::address) + offsets[i]
+#define MAX_VECTOR_ELEMENTS 16
+#define ALL_LANES 0xFFFFFFFF
+static_assert(MAX_VECTOR_ELEMENTS % 4 == 0, "the host gather loads 4 offsets at once");
+struct vector_request {
+    alignas(32) int64_t offsets[MAX_VECTOR_ELEMENTS];   // byte offsets (index * scale)
+    alignas(32) uint64_t data[MAX_VECTOR_ELEMENTS];     // SCATTER: values, GATHER: results
+    uint32_t count = 0;
+    uint32_t mask = ALL_LANES;  // lane i is only accessed if bit i is set
+};
 
-
-struct Memory_Controller_Core {
-    // this needs to be rewritten in assembly for a ULP Core:
+// everything the producer and the controller share
+// only indices and offsets are used -> the channel can live in a shared memory segment
+// which is mapped at different addresses in the producer and the controller process
+struct queue_channel {
+    // bitarrays for the queues:
+    // bytes behind QUEUE_SLOTS are always 0
+    alignas(64) std::atomic<uint8_t> queue_status_bitarray[QUEUE_STATUS_BYTES];
     // IO queues:
     queue_item queue[QUEUE_SLOTS];
+    vector_request vectors[QUEUE_SLOTS];
     RingBuffer reqs;
-    // bitarrays for the queues:
-    std::atomic<uint8_t> queue_status_bitarray[QUEUE_SLOTS];
+    // optional: the controller appends the slot of every finished READ
+    CompletionRing completions;
+    std::atomic<bool> completion_ring_enabled = false;
+    // completions which did not fit into the ring (only in the status bytes)
+    std::atomic<uint64_t> completion_overflows = 0;
+    std::atomic<bool> ready = false;
+    // error register of the controller, mirrored for producers in other processes
+    std::atomic<uint64_t> controller_error = 0;
+    // process of the controller thread, 0 until it started (only for logging)
+    std::atomic<int32_t> controller_pid = 0;
+    // held by the controller thread while it runs (liveness check of the producers):
+    // the kernel releases the robust mutex of a dead thread, also for a zombie child,
+    // across pid namespaces and after the pid was reused -> a producer gets EOWNERDEAD
+    pthread_mutex_t alive_lock;
+
+    queue_channel() {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&alive_lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+};
+static_assert(std::atomic<uint8_t>::is_always_lock_free && std::atomic<size_t>::is_always_lock_free
+    && std::atomic<uint64_t>::is_always_lock_free, "the queue channel needs to be lock free for shared memory");
+
+class SharedMemorySegment;
+class NumaReplicas;
+
+#define MAX_FILE_REGIONS 16
+
+enum class file_mapping {
+    READ_ONLY = 0,      // ROM/firmware: shared page cache, guest writes are ignored
+    COPY_ON_WRITE = 1,  // disk/RAM images: shared page cache until a page is written
+};
+
+// a part of the guest memory which is backed by a file
+struct file_region {
+    uint64_t start = 0;     // relative to the controller
+    uint64_t end = 0;
+    file_mapping mode = file_mapping::READ_ONLY;
+};
+
+#define MAX_ENDIAN_REGIONS 8
+
+// a part of the guest memory with another endianness than the controller (e.g. a device window)
+struct endian_region {
+    uint64_t start = 0;     // relative to the controller
+    uint64_t end = 0;
+    endianness order = endianness::LITTLE;
+};
+
+struct Memory_Controller_Core {
+    // this needs to be rewritten in assembly for a ULP Core:
+    queue_channel _local_channel;
+    // points to _local_channel or into a shared memory segment
+    queue_channel* channel = &_local_channel;
+    // true if _mem_ptr is not owned by the controller (shared memory segment or NUMA replica)
+    bool _shared = false;
+    // read-mostly memory with a replica per NUMA node, WRITEs go to every replica
+    NumaReplicas* _replicas = nullptr;
 
 #ifdef CONTROLLER_DEBUG
         std::atomic<int64_t> last_op_index = -1;
@@ -73,32 +161,170 @@ struct Memory_Controller_Core {
     void debug_queue_bits(int index);
     // DO NOT CHANGE THE MEM_PTR AT RUNTIME EVER!
     // this pointer is a pointer to the memory allocated by mmap and is used by a seperate thread!
-    uint8_t* _mem_ptr;
-    uint64_t _max_address;
-    uint64_t _min_address;
-    uint64_t _size;
+    uint8_t* _mem_ptr = nullptr;
+    // _size and _max_address change with resize(), the handler reads them for routing
+    std::atomic<uint64_t> _max_address = 0;
+    uint64_t _min_address = 0;
+    std::atomic<uint64_t> _size = 0;
+    // virtual address space reserved for resize(), only the first _size bytes are accessible
+    uint64_t _reserved_size = 0;
+    // guest address of the first byte, set by the handler which routes the requests
+    // the queue items use addresses relative to this base
+    uint64_t _guest_base = 0;
+    // guest endianness, the regions override it for their range
+    std::atomic<endianness> _endianness = DEFAULT_ENDIANNESS;
+    endian_region _endian_regions[MAX_ENDIAN_REGIONS];
+    std::atomic<uint32_t> _endian_region_count = 0;
     pthread_t thread;
+    // disabled by default, configure it before enabling
+    StreamPrefetcher prefetcher;
+    // compression of cold pages, see enable_compaction
+    PageCompactor compactor;
+    // watched code pages of a JIT, see enable_code_watch
+    CodeWatch code_watch;
+    // data watchpoints of a guest debugger, only checked while one is armed
+    Watchpoints watchpoints;
+    // file backed regions, entries are only appended while the controller runs
+    file_region _file_regions[MAX_FILE_REGIONS];
+    std::atomic<uint32_t> _file_region_count = 0;
+    std::atomic<uint32_t> _read_only_regions = 0;
+    std::atomic<uint64_t> ignored_rom_writes = 0;
+    // cpu the controller thread is pinned to, -1 means unpinned
+    std::atomic<int> _cpu = -1;
     std::atomic<bool> running = false;
-    std::atomic<bool> ready = false;
+    // a thread was started and is not joined yet, only used by the owner of the controller
+    bool _joinable = false;
+    // another controller took the memory over -> stop() does not free it
+    std::atomic<bool> _handed_over = false;
+    // stopped with free_memory = false, the memory is still mapped
+    bool _memory_kept = false;
+    // requests of a coroutine scheduler which still use this controller
+    // (see MemoryControllerHandler::pin_controller), a removal waits until it is 0
+    std::atomic<uint32_t> _pins = 0;
+    // replace_controller: the controller whose memory this one took over, set until it processed
+    // every request queued on it. The first request of this controller waits for that.
+    std::atomic<Memory_Controller_Core*> _predecessor = nullptr;
+    // loop() returned, set by the controller thread
+    std::atomic<bool> _loop_exited = false;
     void debug_errors();
-    void init(uint64_t size);
+    // reserve: address space reserved to grow the memory at runtime (0 = no growing)
+    void init(uint64_t size, uint64_t reserve = 0);
+    // uses the guest memory and channel "channel_index" of a shared memory segment
+    // the controller process calls start() afterwards, a producer process only uses the queue functions
+    // the segment owns the memory -> stop() does not free it
+    bool init_shared(SharedMemorySegment& segment, uint32_t channel_index);
+    // reads from the replica of the given NUMA node, writes go to all replicas
+    // the replicas own the memory -> stop() does not free it
+    bool init_replica(NumaReplicas& replicas, int node);
     void start();
-    void set_affinity(int core_id);
+    // grows or shrinks the guest memory inside the reserved range, also while the controller runs
+    // the controller only switches the bounds (ordered with the other requests of the queue)
+    // the calling thread commits new pages and gives released pages back after the controller switched the bounds
+    // running controller: call it from the producer thread
+    bool resize(uint64_t new_size);
+    // maps length bytes of the file at file_offset to the controller-relative address
+    // guest_address - _guest_base (both page aligned)
+    // the kernel loads the pages on first access, the page cache is shared between all controllers
+    // mapping the same image. the file region replaces the anonymous memory at this address
+    // with compaction enabled only before start()
+    bool map_file(uint64_t guest_address, const char* path, uint64_t file_offset, uint64_t length, file_mapping mode);
+    // replaces a file region with zeroed anonymous memory, only while the controller is stopped
+    bool unmap_file(uint64_t guest_address);
+    // guest endianness of the controller, takes effect for the following requests
+    void set_endianness(endianness order);
+    // entries are only appended, the region of the first byte of an access decides
+    // address is relative to the controller, like all per-controller APIs
+    bool add_endian_region(uint64_t address, uint64_t length, endianness order);
+    inline endianness endianness_of(uint64_t address) const {
+        endianness order = _endianness.load(std::memory_order_relaxed);
+        uint32_t count = _endian_region_count.load(std::memory_order_acquire);
+        for(uint32_t i = 0; i < count; i++) {
+            if(address >= _endian_regions[i].start && address < _endian_regions[i].end) {
+                return _endian_regions[i].order;
+            }
+        }
+        return order;
+    }
+    // true if [address, address+size) touches a READ_ONLY file region
+    bool is_read_only(uint64_t address, uint64_t size);
+    // allocates the "watched for code" bitmap, call before start()
+    // the JIT uses code_watch.watch()/unwatch() and drains code_watch.pop_event()
+    bool enable_code_watch();
+    // compresses pages which were not accessed for cold_passes scans (one scan every scan_interval_ms)
+    // call after init() and before start(), not available for shared memory
+    bool enable_compaction(uint32_t cold_passes, uint32_t scan_interval_ms);
+    // pins the controller thread to core_id (-1 = unpinned)
+    // can be called before start() or while the controller is running
+    bool set_affinity(int core_id);
     // stops the controller and frees memory
-    void stop();
+    // the requests already queued are finished and the thread is joined before the memory is freed
+    // producers must not queue new requests while stop() runs
+    // free_memory = false: the memory stays mapped (for take_over), a later stop() frees it
+    // memory taken over by another controller is never freed here
+    void stop(bool free_memory = true);
+    // this controller (initialized, not started) uses the memory of old from now on:
+    // memory, guest base, bounds, file and endian regions. old may still run, its stop() then
+    // keeps the memory. Compaction, code watch and watchpoints are not taken over; a running old
+    // controller must not use compaction (detach it first, its stop() decompresses the pages).
+    // old must not be resized or get new regions until it is stopped
+    bool take_over(Memory_Controller_Core& old);
     void loop();
-    int add_to_input_queue(queue_item in);
+    // vector: lanes of a GATHER/SCATTER request, copied into the slot
+    int add_to_input_queue(queue_item in, const vector_request* vector = nullptr);
+    // same as add_to_input_queue but a full queue is not an error -> returns -1
+    int try_add_to_input_queue(queue_item in, const vector_request* vector = nullptr);
+    // producer: the next try_add_to_input_queue finds a free slot
+    bool has_free_slot();
+    // one request for up to MAX_VECTOR_ELEMENTS elements of element_size bytes at base + indices[i] * scale
+    // lanes without their bit in mask are not accessed (GATHER returns 0 for them)
+    // returns the slot like add_to_input_queue
+    int add_gather(uint64_t base, const int64_t* indices, uint32_t count, uint8_t scale, uint16_t element_size, uint32_t mask = ALL_LANES);
+    int add_scatter(uint64_t base, const int64_t* indices, const uint64_t* values, uint32_t count, uint8_t scale, uint16_t element_size, uint32_t mask = ALL_LANES);
+    // waits for the GATHER in slot index and copies count results to out
+    bool get_gather_result(uint64_t index, uint64_t* out);
+    // non blocking check for the result of a READ
+    bool is_output_ready(uint64_t index);
+    // bit i is set if slot i has its output ready (status 3)
+    // scans all status bytes with vector compares -> one cacheline read
+    uint64_t completion_mask();
+    // the completion ring has to be drained by the producer
+    // use either the ring or get_from_output_queue/completion_mask to find finished slots, not both:
+    // a slot harvested directly stays in the ring and is skipped (or reported again after reuse)
+    void enable_completion_ring(bool enable);
+    // pops up to max finished slots from the completion ring, returns the count
+    size_t drain_completions(uint64_t* out, size_t max);
+    // increases when a completion did not fit into the ring -> scan with completion_mask() once
+    uint64_t completion_ring_overflows();
+    // waits until the controller processed the WRITE in slot index (watchpoints, watched code pages)
+    void wait_for_write(uint64_t index);
+    // waits until every request queued by this producer is processed (READ results stay in their slots)
+    // afterwards the code watch events of all queued WRITEs are posted
+    void flush_writes();
+    // watchpoint hit of the last request in slot index, valid until the producer reuses the slot
+    uint32_t get_watchpoint_hit(uint64_t index);
+    // shared channel: true (and CONTROLLER_LOST set) if the controller process died or stopped
+    bool controller_lost();
+    // until_output: a slot with an uncollected READ result (status 3) counts as done
+    void wait_for_slot(uint64_t index, bool until_output);
+    // controller thread: waits until _predecessor has no queued request left, false on an error
+    bool wait_for_predecessor();
     void add_to_output_queue(uint64_t out, uint64_t index);
     bool get_from_input_queue(queue_item*& in);
     uint64_t get_from_output_queue(uint64_t index);
     void wait_for_controller_to_start();
     // Initialize memory with mmap
-    uint8_t* init_mem(uint64_t size);
+    uint8_t* init_mem(uint64_t size, uint64_t reserve = 0);
+    // new bounds and compactor limit, called by the controller thread (or by resize() if the controller is stopped)
+    void set_size(uint64_t size);
     void free_mem(uint8_t* mem);
     // make sure to give a correct memory pointer in the function!!!
     uint64_t get_item(uint8_t* _mem, uint64_t in_address, uint16_t size);
 
     void set_item(uint8_t* _mem, uint64_t in_address, uint64_t data, uint16_t size);
+    // guest WRITE: read-only regions, NUMA replicas and the code watch
+    void store_item(uint64_t address, uint64_t data, uint16_t size);
+    // executes a GATHER/SCATTER in one pass, false on a lane out of bounds
+    bool vector_access(queue_item* in);
 
 
 };
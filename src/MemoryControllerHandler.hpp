@@ -1,8 +1,23 @@
+#ifndef MEMORY_CONTROLLER_HANDLER_HPP
+#define MEMORY_CONTROLLER_HANDLER_HPP
 #include <vector>
 #include "MemControllerAPI.hpp"
 #include "Error_Reg.hpp"
+#include "CpuTopology.hpp"
+#include "NumaReplication.hpp"
+#include "RcuDomain.hpp"
 
+// NOTICE:
+// One producer thread uses the handler (add_to_queue, find_controller), one management thread
+// can add, replace and remove controllers at the same time (add_controller, replace_controller,
+// detach_controller, remove_controller, placement).
+// The controllers are kept in a routing table which is never changed after it is published:
+// a change publishes a copy and the old table is freed after the producer left add_to_queue (RCU).
 
+// routing table of the handler, immutable after it is published
+struct routing_table {
+    std::vector<Memory_Controller_Core*> controllers;
+};
 
 class MemoryControllerHandler {
     public:
@@ -10,87 +25,479 @@ class MemoryControllerHandler {
 
         ~MemoryControllerHandler() {
             stop_controllers();
-            for(Memory_Controller_Core* con : controllers) {
+            routing_table* table = _routing.load(std::memory_order_acquire);
+            for(Memory_Controller_Core* con : table->controllers) {
                 if(con != nullptr) {
                     delete con;
                     con = nullptr;
                 }
             }
-            controllers.clear();
+            delete table;
+            _routing.store(nullptr, std::memory_order_release);
         }
 
-        void add_to_queue(queue_item& in) {
-            for(Memory_Controller_Core* con : controllers) {
-                if(con->_max_address>in.address && con->_min_address > in.address) {
-                    int index = con->add_to_input_queue(in);
-                    if(index == -1) {
-                        switch(in.op) {
-                            case READ: {
-                                SET_MEM_ERROR(READ_ERROR);
-                                return;
-                                break;
-                            }
-                            case WRITE: {
-                                SET_MEM_ERROR(WRITE_ERROR);
-                                return;
-                                break;
-                            }
-                        }
-                    }
+        // returns the controller responsible for the guest address or nullptr
+        // the controllers are laid out one after another in the order they were added
+        // the controller must not be removed while the caller uses it, use pin_controller for that
+        Memory_Controller_Core* find_controller(uint64_t address) {
+            _rcu.enter();
+            Memory_Controller_Core* con = find_in(_routing.load(std::memory_order_acquire), address);
+            _rcu.leave();
+            return con;
+        }
 
-                    if(in.op == READ) {
-                        in.data = con->get_from_output_queue(index);
-#ifdef CONTROLLER_DEBUG
-                        std::cout << "WRITE: slot=" << index << " addr=" << in.address << " data=" << in.data << std::endl;
-                        debug_controller_state();
-#endif
-                    } else {
-#ifdef CONTROLLER_DEBUG
-                        std::cout << "READ: slot=" << index << " addr=" << in.address << std::endl;
-                        debug_controller_state();
-#endif                    
-                    }
-                    return;
-                }
+        // find_controller for a user which keeps the controller after the call (coroutine scheduler):
+        // a removal or replacement of the controller waits until unpin_controller was called
+        Memory_Controller_Core* pin_controller(uint64_t address) {
+            _rcu.enter();
+            Memory_Controller_Core* con = find_in(_routing.load(std::memory_order_acquire), address);
+            if(con != nullptr) {
+                // inside the read section -> seen by the grace period of a removal
+                con->_pins.fetch_add(1, std::memory_order_relaxed);
             }
-            // if we land here we have a boundary error:
-            // this might be changed later
-            SET_MULTIPLE_ERROR(FAST_EXIT|BOUNDARY_ERROR);
-            stop_controllers();
+            _rcu.leave();
+            return con;
+        }
+
+        void unpin_controller(Memory_Controller_Core* con) {
+            con->_pins.fetch_sub(1, std::memory_order_release);
+        }
 
+        void add_to_queue(queue_item& in) {
+            if(in.op != READ && in.op != WRITE) {
+                SET_STANDARD_ERROR(UNDEFINED_ERROR);
+                return;
+            }
+            uint64_t data = in.data;
+            _watchpoint_hit = 0;
+            _rejected = false;
+            // a removed controller stays alive until leave()
+            _rcu.enter();
+            routing_table* routing = _routing.load(std::memory_order_acquire);
+            bool done = access(routing, in.op, in.address, data, in.size);
+            if(!done && !_rejected) {
+                // if we land here we have a boundary error:
+                // this might be changed later
+                SET_MULTIPLE_ERROR((uint64_t)FAST_EXIT|BOUNDARY_ERROR);
+                // still inside the read section: the table and its controllers can not be freed meanwhile
+                stop_all(routing);
+            }
+            _rcu.leave();
+            if(!done) {
+                // a full queue only sets READ_ERROR/WRITE_ERROR, the controllers keep running
+                return;
+            }
+            if(in.op == READ) {
+                in.data = data;
+            }
+            // the producer traps if this is set
+            in.watchpoint = _watchpoint_hit;
         };
 
-        void stop_controllers() {
-            for(Memory_Controller_Core* con : controllers) {
-                con->stop();
+        // producer thread: waits until every controller processed the requests queued on it,
+        // e.g. the fence of a JIT before it runs a translation (code watch events are posted afterwards)
+        void flush_writes() {
+            _rcu.enter();
+            for(Memory_Controller_Core* con : _routing.load(std::memory_order_acquire)->controllers) {
+                con->flush_writes();
             }
+            _rcu.leave();
         }
 
+        // producer outside of add_to_queue or management thread
+        void stop_controllers() {
+            stop_all(table());
+        }
+
+        // the controller gets the guest addresses behind the last controller
+        // (including its reserved size for resize())
+        // can be called while the producer is running
         bool add_controller(Memory_Controller_Core* controller) {
             if(controller != nullptr) {
-                controllers.push_back(controller);
+                routing_table* next = new routing_table(*table());
+                for(Memory_Controller_Core* con : next->controllers) {
+                    if(con->_guest_base + con->_reserved_size > controller->_guest_base) {
+                        controller->_guest_base = con->_guest_base + con->_reserved_size;
+                    }
+                }
+                next->controllers.push_back(controller);
+                cpu_overrides.push_back(-1);
+                publish(next);
                 return true;
             }
             SET_STANDARD_ERROR(UNDEFINED_ERROR);
             return false;
         }
+
+        // removes controller "index" while the producer is running and frees its guest memory:
+        // 1. a routing table without the controller is published -> no new requests are routed to it
+        // 2. waits until the producer left add_to_queue and every scheduler pin is released
+        //    -> no request is queued on it anymore
+        // 3. stop() finishes the queued requests, joins the thread and frees the memory
+        // the guest addresses of the controller are not accessible afterwards, the other controllers keep theirs
+        // use replace_controller or detach_controller to keep the memory
+        bool remove_controller(size_t index) {
+            Memory_Controller_Core* con = unpublish(index, nullptr);
+            if(con == nullptr) {
+                return false;
+            }
+            con->stop();
+#ifdef DEBUG
+            LOG_DEBUG("[HANDLER]: removed controller "+std::to_string(index)+" guest base: "+std::to_string(con->_guest_base));
+#endif
+            delete con;
+            return true;
+        }
+
+        // same as remove_controller, but the memory is not freed: returns the stopped controller
+        // which still owns its memory (the caller owns the controller). A new controller can continue
+        // with the memory (take_over, then add_controller), stop() frees it.
+        Memory_Controller_Core* detach_controller(size_t index) {
+            Memory_Controller_Core* con = unpublish(index, nullptr);
+            if(con == nullptr) {
+                return nullptr;
+            }
+            con->stop(false);
+#ifdef DEBUG
+            LOG_DEBUG("[HANDLER]: detached controller "+std::to_string(index)+" guest base: "+std::to_string(con->_guest_base));
+#endif
+            return con;
+        }
+
+        // hands controller "index" over to replacement while the producer is running (e.g. a controller
+        // with another configuration). replacement: created, not initialized and not started
+        // 1. replacement takes over the memory, guest addresses and regions (take_over) and is started,
+        //    its first request waits until the old controller processed every request queued on it
+        // 2. a routing table with replacement instead of the old controller is published in one update
+        // 3. waits for the producer and the scheduler pins, the old controller finishes its queued requests
+        // both controllers run during the switch -> a READ of the producer never waits for the grace period
+        // the old controller is deleted, the memory is not freed
+        bool replace_controller(size_t index, Memory_Controller_Core* replacement) {
+            if(replacement == nullptr || index >= controller_count()) {
+                SET_STANDARD_ERROR(UNDEFINED_ERROR);
+                return false;
+            }
+            Memory_Controller_Core* old = table()->controllers[index];
+            if(!replacement->take_over(*old)) {
+                return false;
+            }
+            replacement->_predecessor.store(old, std::memory_order_release);
+            replacement->start();
+            if(!replacement->running) {
+                // no thread: the old controller keeps its memory and stays published
+                old->_handed_over.store(false, std::memory_order_release);
+                replacement->_predecessor.store(nullptr, std::memory_order_relaxed);
+                replacement->_mem_ptr = nullptr;
+                return false;
+            }
+            unpublish(index, replacement);
+            old->stop();
+            // the replacement reads the queue of the old controller until it saw the handover
+            while(replacement->_predecessor.load(std::memory_order_acquire) != nullptr
+                  && !replacement->_loop_exited.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+#ifdef DEBUG
+            LOG_DEBUG("[HANDLER]: replaced controller "+std::to_string(index)+" guest base: "+std::to_string(old->_guest_base));
+#endif
+            delete old;
+            return true;
+        }
+
+        size_t controller_count() const {
+            return table()->controllers.size();
+        }
+
+        Memory_Controller_Core* get_controller(size_t index) {
+            routing_table* current = table();
+            if(index >= current->controllers.size()) {
+                return nullptr;
+            }
+            return current->controllers[index];
+        }
+
+        // creates a controller for the replica on the NUMA node of the producer, pinned to that node
+        // every producer uses its own handler with one controller per replica set, WRITEs are written into all replicas
+        // a second controller of the same replicas in this handler is rejected: it would get its own guest addresses
+        // producer_cpu = -1 uses the cpu of the calling thread
+        Memory_Controller_Core* add_replica_controller(NumaReplicas& replicas, int producer_cpu = -1) {
+            for(Memory_Controller_Core* con : table()->controllers) {
+                if(con->_replicas == &replicas) {
+                    SET_STANDARD_ERROR(UNDEFINED_ERROR);
+                    return nullptr;
+                }
+            }
+            if(!load_topology()) {
+                SET_STANDARD_ERROR(UNDEFINED_ERROR);
+                return nullptr;
+            }
+            if(producer_cpu < 0) {
+                producer_cpu = CpuTopology::current_cpu();
+            }
+            const cpu_info* info = topology.get(producer_cpu);
+            int node = info != nullptr ? info->numa_node : 0;
+            Memory_Controller_Core* con = new Memory_Controller_Core();
+            if(!con->init_replica(replicas, node)) {
+                delete con;
+                return nullptr;
+            }
+            add_controller(con);
+            size_t index = controller_count() - 1;
+            int cpu = place_controller(index, producer_cpu, placement::SAME_L3);
+            if(cpu == -1) {
+                cpu = place_controller(index, producer_cpu, placement::SAME_NODE);
+            }
+            con->start();
+            return con;
+        }
+
+        // Thread placement:
+        // reads the cpu topology from sysfs, is called by the placement functions if needed
+        bool load_topology() {
+            if(topology.loaded()) {
+                return true;
+            }
+            return topology.load();
+        }
+
+        const CpuTopology& get_topology() const {
+            return topology;
+        }
+
+        // explicit override: pins controller "index" to "cpu" and excludes it from place_controllers
+        // cpu = -1 removes the override and unpins the controller
+        bool set_controller_cpu(size_t index, int cpu) {
+            routing_table* current = table();
+            if(index >= current->controllers.size()) {
+                SET_STANDARD_ERROR(UNDEFINED_ERROR);
+                return false;
+            }
+            cpu_overrides[index] = cpu;
+            return current->controllers[index]->set_affinity(cpu);
+        }
+
+        // pins a single controller relative to the producer cpu
+        // returns the chosen cpu or -1 if the controller is unpinned
+        int place_controller(size_t index, int producer_cpu, placement where) {
+            routing_table* current = table();
+            if(index >= current->controllers.size() || !load_topology()) {
+                return -1;
+            }
+            std::vector<int> taken = taken_cpus(producer_cpu, index);
+            int cpu = topology.find_cpu(producer_cpu, where, taken);
+            current->controllers[index]->set_affinity(cpu);
+            return cpu;
+        }
+
+        // pins every controller without an override near the producer:
+        // own physical core, but same L3 (or at least the same NUMA node) as the producer
+        // producer_cpu = -1 uses the cpu of the calling thread
+        // returns false if not every controller got its own physical core
+        bool place_controllers(int producer_cpu = -1, placement where = placement::NEAREST) {
+            if(!load_topology()) {
+                return false;
+            }
+            if(producer_cpu < 0) {
+                producer_cpu = CpuTopology::current_cpu();
+            }
+            bool all_placed = true;
+            for(size_t i = 0; i < controller_count(); i++) {
+                if(cpu_overrides[i] >= 0) {
+                    continue;
+                }
+                int cpu = place_controller(i, producer_cpu, where);
+#ifdef DEBUG
+                LOG_DEBUG("[HANDLER]: controller "+std::to_string(i)+" placed on cpu: "+std::to_string(cpu));
+#endif
+                if(cpu == -1) {
+                    all_placed = false;
+                }
+            }
+            return all_placed;
+        }
 #ifdef CONTROLLER_DEBUG
         void debug_controller_state() {
             int count = 1;
-            for(Memory_Controller_Core* con : controllers) {
+            for(Memory_Controller_Core* con : table()->controllers) {
                 std::cerr << "CONTROLLER: " << count << std::endl; 
                 std::cerr << "Controller last_slot: " << con->last_op_index << std::endl;
                 std::cerr << "Controller last_write_data: " << con->last_write_data << std::endl;
                 std::cerr << "Controller last_read_addr: " << con->last_read_addr << std::endl;
                 std::cerr << "Controller last_read_result: " << con->last_read_result << std::endl;
                 std::cerr << "Controller last_operation: " << con->last_operation << std::endl;
-                con->reqs.debug_state();
+                con->channel->reqs.debug_state(con->channel->queue);
                 con->debug_queue_bits();
                 count++;
             }
         }
 #endif
     private:
+        // a READ or WRITE of size bytes at the guest address
+        // an access crossing the end of a controller is split, the parts are recombined
+        // in the endianness of the controller of the first byte
+        bool access(routing_table* routing, memory_ops op, uint64_t address, uint64_t& data, uint64_t size) {
+            Memory_Controller_Core* con = find_in(routing, address);
+            if(con == nullptr) {
+                return false;
+            }
+            uint64_t local = address - con->_guest_base;
+            uint64_t available = con->_size.load(std::memory_order_acquire) - local;
+            if(size <= available || size > 8) {
+                // an invalid size is rejected by the controller
+                return submit(con, op, local, data, size);
+            }
+            uint64_t first = available;
+            uint64_t second = size - first;
+            bool big = con->endianness_of(local) == endianness::BIG;
+            // big endian: the lower address holds the upper bytes
+            uint64_t shift = (big ? second : first) * 8;
+            uint64_t low_mask = (1ULL << shift) - 1;
+            uint64_t first_data = 0;
+            uint64_t second_data = 0;
+            if(op == WRITE) {
+                first_data = big ? data >> shift : data & low_mask;
+                second_data = big ? data & low_mask : data >> shift;
+            }
+#ifdef DEBUG
+            LOG_DEBUG("[HANDLER]: splitting access at: "+std::to_string(address)+" into "+std::to_string(first)+" + "+std::to_string(second)+" bytes");
+#endif
+            if(!submit(con, op, local, first_data, first) || !access(routing, op, address + first, second_data, second)) {
+                return false;
+            }
+            if(op == READ) {
+                data = big ? (first_data << shift) | second_data : first_data | (second_data << shift);
+            }
+            return true;
+        }
+
+        bool submit(Memory_Controller_Core* con, memory_ops op, uint64_t local, uint64_t& data, uint64_t size) {
+            queue_item in;
+            in.op = op;
+            in.address = local;
+            in.data = data;
+            in.size = size;
+            int index = con->add_to_input_queue(in);
+            if(index == -1) {
+                // the request was not queued -> a split access must not continue with its second part
+                _rejected = true;
+                switch(op) {
+                    case READ: {
+                        SET_MEM_ERROR(READ_ERROR);
+                        break;
+                    }
+                    case WRITE: {
+                        SET_MEM_ERROR(WRITE_ERROR);
+                        break;
+                    }
+                    default: {
+                        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+                        break;
+                    }
+                }
+                return false;
+            }
+            if(op == READ) {
+                data = con->get_from_output_queue(index);
+                if(_watchpoint_hit == 0) {
+                    _watchpoint_hit = con->get_watchpoint_hit(index);
+                }
+#ifdef CONTROLLER_DEBUG
+                std::cout << "READ: slot=" << index << " addr=" << local << " data=" << data << std::endl;
+                debug_controller_state();
+#endif
+            } else {
+                if(con->watchpoints.armed()) {
+                    // WRITEs are synchronous while debugging, so the hit belongs to this request
+                    con->wait_for_write(index);
+                    if(_watchpoint_hit == 0) {
+                        _watchpoint_hit = con->get_watchpoint_hit(index);
+                    }
+                }
+#ifdef CONTROLLER_DEBUG
+                std::cout << "WRITE: slot=" << index << " addr=" << local << std::endl;
+                debug_controller_state();
+#endif
+            }
+            return true;
+        }
+
+        // publishes a table without controller "index" (or with replacement at its place) and waits
+        // until neither the producer nor a pinned scheduler request uses the controller anymore
+        Memory_Controller_Core* unpublish(size_t index, Memory_Controller_Core* replacement) {
+            routing_table* old = table();
+            if(index >= old->controllers.size()) {
+                SET_STANDARD_ERROR(UNDEFINED_ERROR);
+                return nullptr;
+            }
+            Memory_Controller_Core* con = old->controllers[index];
+            routing_table* next = new routing_table(*old);
+            if(replacement != nullptr) {
+                next->controllers[index] = replacement;
+            } else {
+                next->controllers.erase(next->controllers.begin() + index);
+                cpu_overrides.erase(cpu_overrides.begin() + index);
+            }
+            publish(next);
+            // no new pin after the grace period, the scheduler of the producer releases the others
+            while(con->_pins.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+            return con;
+        }
+
+        static void stop_all(routing_table* routing) {
+            for(Memory_Controller_Core* con : routing->controllers) {
+                con->stop();
+            }
+        }
+
+        static Memory_Controller_Core* find_in(routing_table* routing, uint64_t address) {
+            for(Memory_Controller_Core* con : routing->controllers) {
+                if(address >= con->_guest_base && address - con->_guest_base < con->_size.load(std::memory_order_acquire)) {
+                    return con;
+                }
+            }
+            return nullptr;
+        }
+
+        // current routing table, only for the management side (the only thread which publishes)
+        routing_table* table() const {
+            return _routing.load(std::memory_order_acquire);
+        }
+
+        // replaces the routing table, the old one is freed after the producer stopped using it
+        void publish(routing_table* next) {
+            routing_table* old = _routing.exchange(next, std::memory_order_acq_rel);
+            _rcu.synchronize();
+            delete old;
+        }
+
+        // cpus used by the producer, the overrides and all controllers placed before "index"
+        std::vector<int> taken_cpus(int producer_cpu, size_t index) {
+            std::vector<Memory_Controller_Core*>& controllers = table()->controllers;
+            std::vector<int> taken;
+            taken.push_back(producer_cpu);
+            for(size_t i = 0; i < controllers.size(); i++) {
+                if(i == index) {
+                    continue;
+                }
+                int cpu = cpu_overrides[i] >= 0 ? cpu_overrides[i] : controllers[i]->_cpu.load();
+                if(cpu >= 0 && (cpu_overrides[i] >= 0 || i < index)) {
+                    taken.push_back(cpu);
+                }
+            }
+            return taken;
+        }
+
+        std::atomic<routing_table*> _routing = new routing_table();
+        RcuDomain _rcu;
+        // watchpoint hit of the current add_to_queue (first hit of a split access)
+        uint32_t _watchpoint_hit = 0;
+        // the current add_to_queue failed because a controller queue was full (not a boundary error)
+        bool _rejected = false;
+        // explicit cpu per controller, -1 = placed by place_controllers
+        std::vector<int> cpu_overrides;
+        CpuTopology topology;
+};
 
-        std::vector<Memory_Controller_Core*> controllers;
-};
\ No newline at end of file
+#endif // MEMORY_CONTROLLER_HANDLER_HPP
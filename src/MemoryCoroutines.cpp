@@ -0,0 +1,201 @@
+#include "MemoryCoroutines.hpp"
+
+bool mem_request::await_suspend(std::coroutine_handle<> h) {
+    waiter = h;
+    // pinned until the request is done -> the controller can not be removed under the suspended task
+    con = scheduler->_handler.pin_controller(item.address);
+    if(con == nullptr) {
+        // same behaviour as MemoryControllerHandler::add_to_queue
+        SET_MULTIPLE_ERROR((uint64_t)FAST_EXIT|BOUNDARY_ERROR);
+        item.data = 0;
+        return false;
+    }
+    uint64_t local = item.address - con->_guest_base;
+    if(item.size <= 8 && item.size > con->_size.load(std::memory_order_acquire) - local) {
+        // crosses the end of the controller: split and recombined by the handler like add_to_queue
+        scheduler->_handler.unpin_controller(con);
+        con = nullptr;
+        split = true;
+    } else {
+        // the queue items use addresses relative to the controller
+        item.address = local;
+    }
+    if(!scheduler->_pending.empty() || !scheduler->submit(this)) {
+        // keep the order of waiting requests
+        scheduler->_pending.push_back(this);
+        return true;
+    }
+    // a WRITE is done for the producer as soon as it is queued, a split access is done
+    return item.op == memory_ops::READ && !split;
+}
+
+mem_request MemoryScheduler::read(uint64_t address, uint64_t size) {
+    mem_request req{this};
+    req.item.op = memory_ops::READ;
+    req.item.address = address;
+    req.item.size = size;
+    return req;
+}
+
+mem_request MemoryScheduler::write(uint64_t address, uint64_t data, uint64_t size) {
+    mem_request req{this};
+    req.item.op = memory_ops::WRITE;
+    req.item.address = address;
+    req.item.data = data;
+    req.item.size = size;
+    return req;
+}
+
+void MemoryScheduler::spawn(mem_task task) {
+    _ready.push_back(task.handle);
+    _tasks.push_back(std::move(task));
+}
+
+bool MemoryScheduler::submit(mem_request* req) {
+    if(req->split) {
+        return submit_split(req);
+    }
+    int index = req->con->try_add_to_input_queue(req->item);
+    if(index == -1) {
+        return false;
+    }
+    req->slot = index;
+    if(req->item.op == memory_ops::READ) {
+        _in_flight.push_back(req);
+    } else {
+        // a removal drains the queued WRITE
+        _handler.unpin_controller(req->con);
+    }
+#ifdef DEBUG
+    LOG_DEBUG("[SCHEDULER]: submitted request on slot: "+std::to_string(index));
+#endif
+    return true;
+}
+
+bool MemoryScheduler::submit_split(mem_request* req) {
+    Memory_Controller_Core* first = _handler.pin_controller(req->item.address);
+    if(first == nullptr) {
+        // the controller was removed meanwhile
+        SET_MULTIPLE_ERROR((uint64_t)FAST_EXIT|BOUNDARY_ERROR);
+        req->item.data = 0;
+        return true;
+    }
+    Memory_Controller_Core* second = _handler.pin_controller(first->_guest_base + first->_size.load(std::memory_order_acquire));
+    bool queued = false;
+    if(second == nullptr) {
+        // same behaviour as MemoryControllerHandler::add_to_queue
+        SET_MULTIPLE_ERROR((uint64_t)FAST_EXIT|BOUNDARY_ERROR);
+        req->item.data = 0;
+        queued = true;
+    } else if(first->has_free_slot() && second->has_free_slot()) {
+        // the earlier requests on both controllers are processed first (FIFO), a READ waits for both parts
+        _handler.add_to_queue(req->item);
+        queued = true;
+    }
+    _handler.unpin_controller(first);
+    if(second != nullptr) {
+        _handler.unpin_controller(second);
+    }
+    return queued;
+}
+
+void MemoryScheduler::submit_pending() {
+    while(!_pending.empty()) {
+        mem_request* req = _pending.front();
+        if(!submit(req)) {
+            return;
+        }
+        _pending.pop_front();
+        if(req->item.op == memory_ops::WRITE || req->split) {
+            _ready.push_back(req->waiter);
+        }
+    }
+}
+
+void MemoryScheduler::harvest() {
+    // one completion scan per controller and round
+    _masks.clear();
+    size_t i = 0;
+    while(i < _in_flight.size()) {
+        mem_request* req = _in_flight[i];
+        uint64_t mask = 0;
+        bool scanned = false;
+        for(auto& entry : _masks) {
+            if(entry.first == req->con) {
+                mask = entry.second;
+                scanned = true;
+                break;
+            }
+        }
+        if(!scanned) {
+            mask = req->con->completion_mask();
+            _masks.push_back({req->con, mask});
+        }
+        if(!(mask & (1ULL << req->slot))) {
+            i++;
+            continue;
+        }
+        // the slot is ready -> get_from_output_queue does not spin
+        req->item.data = req->con->get_from_output_queue(req->slot);
+        _handler.unpin_controller(req->con);
+        _ready.push_back(req->waiter);
+        _in_flight[i] = _in_flight.back();
+        _in_flight.pop_back();
+    }
+}
+
+void MemoryScheduler::resume_ready() {
+    // resumed tasks can add new ready tasks -> swap first
+    std::vector<std::coroutine_handle<>> ready;
+    ready.swap(_ready);
+    for(std::coroutine_handle<> h : ready) {
+        h.resume();
+    }
+    size_t i = 0;
+    while(i < _tasks.size()) {
+        if(_tasks[i].handle.done()) {
+            _tasks[i] = std::move(_tasks.back());
+            _tasks.pop_back();
+            continue;
+        }
+        i++;
+    }
+}
+
+size_t MemoryScheduler::poll() {
+    CATCH_ALL_MULTIPLE_ERROR(ALL_CRITICAL_ERRORS|ALL_MEMORY_ERRORS) {
+#ifdef DEBUG
+        LOG_DEBUG("[SCHEDULER]: controller had error -> aborting requests");
+#endif
+        abort_all();
+    } else {
+        submit_pending();
+        harvest();
+    }
+    size_t resumed = _ready.size();
+    resume_ready();
+    return resumed;
+}
+
+void MemoryScheduler::run() {
+    while(!_tasks.empty()) {
+        poll();
+    }
+}
+
+void MemoryScheduler::abort_all() {
+    for(mem_request* req : _in_flight) {
+        req->item.data = 0;
+        _handler.unpin_controller(req->con);
+        _ready.push_back(req->waiter);
+    }
+    _in_flight.clear();
+    for(mem_request* req : _pending) {
+        req->item.data = 0;
+        if(req->con != nullptr) {
+            _handler.unpin_controller(req->con);
+        }
+        _ready.push_back(req->waiter);
+    }
+    _pending.clear();
+}
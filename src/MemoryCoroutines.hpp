@@ -0,0 +1,129 @@
+#ifndef MEMORY_COROUTINES_HPP
+#define MEMORY_COROUTINES_HPP
+#include <coroutine>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "MemoryControllerHandler.hpp"
+#include "Error_Reg.hpp"
+
+// NOTICE:
+// Coroutine interface for the memory controllers.
+// Every guest context is a mem_task, memory accesses are awaited:
+//
+//     mem_task guest(MemoryScheduler& mem) {
+//         co_await mem.write(0x1000, 0xC0FFEE, 3);
+//         uint64_t value = co_await mem.read(0x1000, 3);
+//     }
+//
+// The MemoryScheduler runs all tasks on the calling thread. A READ suspends the task until
+// the controller wrote the result, the scheduler polls all outstanding slots in one round and
+// resumes the ready tasks. A WRITE only suspends if the queue of the controller is full.
+// The scheduler is the only producer for its controllers (the RingBuffer is single producer).
+// An access crossing the end of a controller is split by the handler (MemoryControllerHandler::add_to_queue)
+// once both controllers have a free slot; it is done synchronously, the task does not suspend for it.
+// A request pins its controller until its READ result is harvested (a WRITE until it is queued),
+// remove_controller/replace_controller on the management thread wait for these pins.
+
+class MemoryScheduler;
+
+struct mem_task {
+    struct promise_type {
+        mem_task get_return_object() {
+            return mem_task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        // the scheduler resumes the task for the first time
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        // the scheduler destroys the finished task
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() {
+            SET_CRITICAL_ERROR(UNDEFINED_CRITICAL_ERROR);
+        }
+    };
+
+    explicit mem_task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    mem_task(mem_task&& other) noexcept : handle(other.handle) {
+        other.handle = nullptr;
+    }
+    mem_task& operator=(mem_task&& other) noexcept {
+        if(this != &other) {
+            if(handle) {
+                handle.destroy();
+            }
+            handle = other.handle;
+            other.handle = nullptr;
+        }
+        return *this;
+    }
+    mem_task(const mem_task&) = delete;
+    mem_task& operator=(const mem_task&) = delete;
+    ~mem_task() {
+        if(handle) {
+            handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// awaitable for a single memory request, lives in the frame of the suspended task
+struct mem_request {
+    explicit mem_request(MemoryScheduler* owner) : scheduler(owner) {}
+
+    MemoryScheduler* scheduler = nullptr;
+    queue_item item{};
+    Memory_Controller_Core* con = nullptr;
+    int64_t slot = -1;
+    // crosses the end of its controller: the handler splits it (item keeps the guest address)
+    bool split = false;
+    std::coroutine_handle<> waiter = nullptr;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h);
+    // READ: the data read, WRITE: the data written
+    uint64_t await_resume() const noexcept { return item.data; }
+};
+
+class MemoryScheduler {
+    public:
+        explicit MemoryScheduler(MemoryControllerHandler& handler) : _handler(handler) {}
+
+        mem_request read(uint64_t address, uint64_t size);
+        mem_request write(uint64_t address, uint64_t data, uint64_t size);
+
+        // the task is started with the next poll()
+        void spawn(mem_task task);
+        // one scheduling round: submits waiting requests, harvests finished slots and resumes
+        // the ready tasks. returns the number of resumed tasks
+        size_t poll();
+        // polls until every task has finished or an error occurred
+        void run();
+
+        size_t tasks() const { return _tasks.size(); }
+        size_t in_flight() const { return _in_flight.size(); }
+
+    private:
+        friend struct mem_request;
+        // returns false if the request could not be queued (queue full)
+        bool submit(mem_request* req);
+        // split access: queued and done synchronously by the handler once both controllers have a free slot
+        bool submit_split(mem_request* req);
+        void submit_pending();
+        void harvest();
+        void resume_ready();
+        // resumes every waiting task after a controller error, reads return 0
+        void abort_all();
+
+        MemoryControllerHandler& _handler;
+        std::vector<mem_task> _tasks;
+        std::vector<std::coroutine_handle<>> _ready;
+        // requests which did not fit into the queue of their controller (FIFO)
+        std::deque<mem_request*> _pending;
+        // READs waiting for their output
+        std::vector<mem_request*> _in_flight;
+        // completion masks of the current harvest round
+        std::vector<std::pair<Memory_Controller_Core*, uint64_t>> _masks;
+};
+
+#endif // MEMORY_COROUTINES_HPP
@@ -0,0 +1,90 @@
+#include "NumaReplication.hpp"
+#include "Error_Reg.hpp"
+#include "Logger.hpp"
+#include <cstring>
+#include <sys/mman.h>
+#include <thread>
+
+NumaReplicas::~NumaReplicas() {
+    for(uint32_t i = 0; i < _count; i++) {
+        munmap(_replicas[i], _size);
+        _replicas[i] = nullptr;
+    }
+    _count = 0;
+}
+
+bool NumaReplicas::init(uint64_t size, const CpuTopology& topology) {
+    if(_count != 0 || size == 0 || !topology.loaded()) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    _size = size;
+    for(const cpu_info& info : topology.cpus()) {
+        bool known = false;
+        for(uint32_t i = 0; i < _count; i++) {
+            if(_nodes[i] == info.numa_node) {
+                known = true;
+                break;
+            }
+        }
+        if(known) {
+            continue;
+        }
+        if(_count >= MAX_NUMA_NODES) {
+            break;
+        }
+        void* mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mem == MAP_FAILED) {
+            SET_MEM_ERROR(ALLOC_ERROR);
+            return false;
+        }
+        _replicas[_count] = (uint8_t*)mem;
+        _nodes[_count] = info.numa_node;
+        _cpus[_count] = info.cpu;
+        _count++;
+    }
+    // first touch from a cpu of the node places the pages on the node
+    std::vector<std::thread> threads;
+    for(uint32_t i = 0; i < _count; i++) {
+        threads.emplace_back([this, i]() {
+            CpuTopology::pin_current_thread(_cpus[i]);
+            memset(_replicas[i], 0, _size);
+        });
+    }
+    for(std::thread& t : threads) {
+        t.join();
+    }
+#ifdef DEBUG
+    LOG_DEBUG("[NUMA]: "+std::to_string(_count)+" replicas of "+std::to_string(size)+" bytes");
+#endif
+    return true;
+}
+
+bool NumaReplicas::load(uint64_t address, const uint8_t* data, uint64_t length) {
+    if(address > _size || length > _size - address) {
+        SET_MEM_ERROR(BOUNDARY_ERROR);
+        return false;
+    }
+    for(uint32_t i = 0; i < _count; i++) {
+        memcpy(_replicas[i] + address, data, length);
+    }
+    return true;
+}
+
+uint8_t* NumaReplicas::replica_of_node(int node) const {
+    for(uint32_t i = 0; i < _count; i++) {
+        if(_nodes[i] == node) {
+            return _replicas[i];
+        }
+    }
+    return nullptr;
+}
+
+int NumaReplicas::cpu_of_node(int node) const {
+    for(uint32_t i = 0; i < _count; i++) {
+        if(_nodes[i] == node) {
+            return _cpus[i];
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,64 @@
+#ifndef NUMA_REPLICATION_HPP
+#define NUMA_REPLICATION_HPP
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <immintrin.h>
+#include "CpuTopology.hpp"
+
+// NOTICE:
+// Replicas of read-mostly guest memory (ROM, kernel text) on every NUMA node.
+// The pages of a replica are placed on their node by first touch from a thread
+// running on a cpu of that node, no libnuma needed.
+// Every controller created with init_replica() reads from the replica of its own node,
+// a WRITE is written into all replicas by the controller which processes it.
+// The controllers of all producers share the replicas: a WRITE holds the write lock
+// while it updates every replica, so all replicas see the WRITEs in the same order.
+// Each producer uses its own handler with one controller on its own node
+// (see MemoryControllerHandler::add_replica_controller).
+
+#define MAX_NUMA_NODES 8
+
+class NumaReplicas {
+    public:
+        NumaReplicas() = default;
+        ~NumaReplicas();
+        NumaReplicas(const NumaReplicas&) = delete;
+        NumaReplicas& operator=(const NumaReplicas&) = delete;
+
+        // allocates one replica of size bytes per NUMA node with cpus
+        bool init(uint64_t size, const CpuTopology& topology);
+        // copies data into every replica (e.g. the ROM image), before the controllers are started
+        bool load(uint64_t address, const uint8_t* data, uint64_t length);
+
+        uint64_t size() const { return _size; }
+        uint32_t count() const { return _count; }
+        // replica by index (0 .. count-1)
+        uint8_t* get(uint32_t index) const { return _replicas[index]; }
+        // replica of a NUMA node, nullptr if the node has no replica
+        uint8_t* replica_of_node(int node) const;
+        // a cpu of the node, -1 if unknown
+        int cpu_of_node(int node) const;
+
+        // serializes the WRITE broadcasts of the controllers, held for one WRITE only
+        inline void lock_writes() {
+            while(_write_lock.exchange(true, std::memory_order_acquire)) {
+                while(_write_lock.load(std::memory_order_relaxed)) {
+                    _mm_pause();
+                }
+            }
+        }
+        inline void unlock_writes() {
+            _write_lock.store(false, std::memory_order_release);
+        }
+
+    private:
+        uint8_t* _replicas[MAX_NUMA_NODES] = {};
+        int _nodes[MAX_NUMA_NODES] = {};
+        int _cpus[MAX_NUMA_NODES] = {};
+        uint32_t _count = 0;
+        uint64_t _size = 0;
+        std::atomic<bool> _write_lock = false;
+};
+
+#endif // NUMA_REPLICATION_HPP
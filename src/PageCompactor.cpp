@@ -0,0 +1,273 @@
+#include "PageCompactor.hpp"
+#include "LzCodec.hpp"
+#include "Logger.hpp"
+#include "Error_Reg.hpp"
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+uint8_t* CompressedPool::allocate(size_t size) {
+    size_t block = block_size(size);
+    size_t index = block / COMPACT_CLASS_SIZE - 1;
+    if(_free[index] == nullptr) {
+        // carve a new slab into blocks of this class
+        uint8_t* slab = new (std::nothrow) uint8_t[COMPACT_SLAB_SIZE];
+        if(slab == nullptr) {
+            return nullptr;
+        }
+        _slabs.emplace_back(slab);
+        for(size_t offset = 0; offset + block <= COMPACT_SLAB_SIZE; offset += block) {
+            free(slab + offset, block);
+        }
+    }
+    uint8_t* result = _free[index];
+    memcpy(&_free[index], result, sizeof(uint8_t*));
+    return result;
+}
+
+void CompressedPool::free(uint8_t* block, size_t size) {
+    size_t index = block_size(size) / COMPACT_CLASS_SIZE - 1;
+    memcpy(block, &_free[index], sizeof(uint8_t*));
+    _free[index] = block;
+}
+
+void CompressedPool::clear() {
+    for(uint8_t*& head : _free) {
+        head = nullptr;
+    }
+    _slabs.clear();
+}
+
+bool PageCompactor::init(uint64_t mem_size, uint32_t cold_passes, uint32_t scan_interval_ms) {
+    if(sysconf(_SC_PAGESIZE) != COMPACT_PAGE_SIZE || cold_passes == 0) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    _pages = (mem_size + COMPACT_PAGE_SIZE - 1) >> COMPACT_PAGE_SHIFT;
+    _limit = _pages;
+    _cold_passes = cold_passes > 255 ? 255 : cold_passes;
+    _scan_interval = std::chrono::milliseconds(scan_interval_ms);
+    _accessed.assign((_pages + 63) / 64, 0);
+    _compressed.assign((_pages + 63) / 64, 0);
+    _excluded.assign((_pages + 63) / 64, 0);
+    _age.assign(_pages, 0);
+    _blocks.clear();
+    _pool.assign(_pages, nullptr);
+    _pool_size.assign(_pages, 0);
+    _cursor = 0;
+    _in_pass = false;
+    _last_pass = std::chrono::steady_clock::now();
+    _enabled = true;
+#ifdef DEBUG
+    LOG_DEBUG("[COMPACTOR]: tracking "+std::to_string(_pages)+" pages, cold after "+std::to_string(_cold_passes)+" scans");
+#endif
+    return true;
+}
+
+void PageCompactor::release(uint8_t* mem) {
+    if(!_enabled) {
+        return;
+    }
+    if(mem != nullptr) {
+        for(uint64_t page = 0; page < _pages; page++) {
+            if(_compressed[page >> 6] & (1ULL << (page & 63))) {
+                decompress_page(mem, page);
+            }
+        }
+    }
+    _enabled = false;
+    _accessed.clear();
+    _compressed.clear();
+    _excluded.clear();
+    _age.clear();
+    _pool.clear();
+    _pool_size.clear();
+    _blocks.clear();
+    _slab_bytes.store(0, std::memory_order_relaxed);
+}
+
+void PageCompactor::exclude(uint64_t address, uint64_t length) {
+    if(!_enabled || length == 0) {
+        return;
+    }
+    uint64_t last = (address + length - 1) >> COMPACT_PAGE_SHIFT;
+    for(uint64_t page = address >> COMPACT_PAGE_SHIFT; page <= last && page < _pages; page++) {
+        _excluded[page >> 6] |= 1ULL << (page & 63);
+    }
+}
+
+void PageCompactor::discard(uint64_t address, uint64_t length) {
+    if(!_enabled || length == 0) {
+        return;
+    }
+    uint64_t last = (address + length - 1) >> COMPACT_PAGE_SHIFT;
+    for(uint64_t page = address >> COMPACT_PAGE_SHIFT; page <= last && page < _pages; page++) {
+        if((page & 63) == 0 && _compressed[page >> 6] == 0) {
+            // nothing compressed in the next 64 pages
+            page += 63;
+            continue;
+        }
+        uint64_t bit = 1ULL << (page & 63);
+        if(!(_compressed[page >> 6] & bit)) {
+            continue;
+        }
+        if(_pool[page]) {
+            release_block(page);
+        } else {
+            counter_add(_zero_pages, -1);
+        }
+        _compressed[page >> 6] &= ~bit;
+        counter_add(_compressed_pages, -1);
+    }
+}
+
+void PageCompactor::set_limit(uint64_t mem_size) {
+    _limit = (mem_size + COMPACT_PAGE_SIZE - 1) >> COMPACT_PAGE_SHIFT;
+    if(_limit > _pages) {
+        _limit = _pages;
+    }
+    if(_cursor > _limit) {
+        _cursor = _limit;
+    }
+}
+
+void PageCompactor::idle_step(uint8_t* mem, const RingBuffer* pending) {
+    if(!_in_pass) {
+        // reading the clock on every idle iteration would slow down the next request
+        if(++_idle_count < COMPACT_CLOCK_CHECK) {
+            return;
+        }
+        _idle_count = 0;
+        auto now = std::chrono::steady_clock::now();
+        if(now - _last_pass < _scan_interval) {
+            return;
+        }
+        _last_pass = now;
+        _in_pass = true;
+        _cursor = 0;
+    }
+    uint64_t end = _cursor + COMPACT_PAGES_PER_STEP;
+    if(end > _limit) {
+        end = _limit;
+    }
+    // residency of the pages in this step, untouched pages are skipped
+    unsigned char resident[COMPACT_PAGES_PER_STEP];
+    if(mincore(mem + (_cursor << COMPACT_PAGE_SHIFT), (end - _cursor) << COMPACT_PAGE_SHIFT, resident) == -1) {
+        memset(resident, 1, sizeof(resident));
+    }
+    for(uint64_t page = _cursor; page < end; page++) {
+        uint64_t bit = 1ULL << (page & 63);
+        if(_accessed[page >> 6] & bit) {
+            _accessed[page >> 6] &= ~bit;
+            _age[page] = 0;
+            continue;
+        }
+        if(_age[page] < 255) {
+            _age[page]++;
+        }
+        if((_compressed[page >> 6] & bit) || (_excluded[page >> 6] & bit) || !(resident[page - _cursor] & 1)) {
+            continue;
+        }
+        if(_age[page] >= _cold_passes) {
+            scan_page(mem, page);
+            if(pending != nullptr && !pending->empty()) {
+                // a request waits -> continue with the next page later
+                _cursor = page + 1;
+                if(_cursor >= _limit) {
+                    _in_pass = false;
+                }
+                return;
+            }
+        }
+    }
+    _cursor = end;
+    if(_cursor >= _limit) {
+        _in_pass = false;
+    }
+}
+
+void PageCompactor::scan_page(uint8_t* mem, uint64_t page) {
+    if(!compress_page(mem, page)) {
+        // not worth it -> try again after the next cold period
+        _age[page] = 0;
+    }
+}
+
+bool PageCompactor::compress_page(uint8_t* mem, uint64_t page) {
+    uint8_t* ptr = mem + (page << COMPACT_PAGE_SHIFT);
+    bool zero = true;
+    const uint64_t* words = (const uint64_t*)ptr;
+    for(int i = 0; i < COMPACT_PAGE_SIZE / 8; i++) {
+        if(words[i] != 0) {
+            zero = false;
+            break;
+        }
+    }
+    if(zero) {
+        _pool[page] = nullptr;
+        _pool_size[page] = 0;
+        counter_add(_zero_pages, 1);
+    } else {
+        size_t size = lz_compress(ptr, COMPACT_PAGE_SIZE, _scratch, COMPACT_MAX_STORED);
+        if(size == 0) {
+            return false;
+        }
+        uint64_t slabs = _blocks.slab_bytes();
+        _pool[page] = _blocks.allocate(size);
+        if(_pool[page] == nullptr) {
+            return false;
+        }
+        counter_add(_slab_bytes, _blocks.slab_bytes() - slabs);
+        memcpy(_pool[page], _scratch, size);
+        _pool_size[page] = (uint16_t)size;
+        counter_add(_pool_bytes, CompressedPool::block_size(size));
+    }
+    // the next access reads zeros -> touch() decompresses before that
+    if(madvise(ptr, COMPACT_PAGE_SIZE, MADV_DONTNEED) == -1) {
+        if(zero) {
+            counter_add(_zero_pages, -1);
+        } else {
+            release_block(page);
+        }
+        return false;
+    }
+    _compressed[page >> 6] |= 1ULL << (page & 63);
+    counter_add(_compressed_pages, 1);
+    return true;
+}
+
+void PageCompactor::decompress_page(uint8_t* mem, uint64_t page) {
+    uint8_t* ptr = mem + (page << COMPACT_PAGE_SHIFT);
+    if(_pool[page]) {
+        // the page was released and reads as zero
+        if(lz_decompress(_pool[page], _pool_size[page], ptr, COMPACT_PAGE_SIZE) != COMPACT_PAGE_SIZE) {
+            SET_MEM_ERROR(MEMORY_ERROR);
+        }
+        release_block(page);
+    } else {
+        counter_add(_zero_pages, -1);
+    }
+    _compressed[page >> 6] &= ~(1ULL << (page & 63));
+    _age[page] = 0;
+    counter_add(_compressed_pages, -1);
+    counter_add(_decompressions, 1);
+}
+
+void PageCompactor::release_block(uint64_t page) {
+    counter_add(_pool_bytes, -(int64_t)CompressedPool::block_size(_pool_size[page]));
+    _blocks.free(_pool[page], _pool_size[page]);
+    _pool[page] = nullptr;
+    _pool_size[page] = 0;
+}
+
+uint64_t PageCompactor::saved_bytes() const {
+    uint64_t released = compressed_pages() * COMPACT_PAGE_SIZE;
+    uint64_t pool = pool_bytes();
+    return released > pool ? released - pool : 0;
+}
+
+void PageCompactor::debug_state() const {
+    std::cout << "Compactor: compressed pages: " << compressed_pages() << " zero pages: " << zero_pages()
+              << " pool bytes: " << pool_bytes() << " slab bytes: " << slab_bytes() << " saved bytes: " << saved_bytes()
+              << " decompressions: " << decompressions() << std::endl;
+}
@@ -0,0 +1,134 @@
+#ifndef PAGE_COMPACTOR_HPP
+#define PAGE_COMPACTOR_HPP
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "RingBuffer_QueueItems.hpp"
+
+// NOTICE:
+// Compression of cold guest pages.
+// Runs on the controller thread only -> no locking against get_item/set_item:
+// - touch() is called before every request, marks the page as accessed and
+//   decompresses it if it was compressed (the "fault path").
+// - idle_step() is called when the input queue is empty and scans a few pages:
+//   a resident page which was not accessed for cold_passes scans gets compressed
+//   into the pool and its memory is given back with madvise(MADV_DONTNEED).
+// Zero pages are not stored at all, a released anonymous page reads as zero.
+
+#define COMPACT_PAGE_SIZE 4096
+#define COMPACT_PAGE_SHIFT 12
+// pages scanned per idle_step
+#define COMPACT_PAGES_PER_STEP 16
+// a page is only stored if it compresses to this size or less
+#define COMPACT_MAX_STORED (COMPACT_PAGE_SIZE * 3 / 4)
+// idle loop iterations between two clock reads
+#define COMPACT_CLOCK_CHECK 1024
+// the pool hands out blocks of multiples of COMPACT_CLASS_SIZE, carved from slabs of COMPACT_SLAB_SIZE
+#define COMPACT_CLASS_SIZE 256
+#define COMPACT_CLASSES (COMPACT_MAX_STORED / COMPACT_CLASS_SIZE)
+#define COMPACT_SLAB_SIZE (64 * 1024)
+
+// slab allocator for the compressed pages: one free list per size class,
+// no heap allocation per page. Slabs are only given back by clear().
+class CompressedPool {
+    public:
+        // block for size bytes (size <= COMPACT_MAX_STORED), nullptr if out of memory
+        uint8_t* allocate(size_t size);
+        void free(uint8_t* block, size_t size);
+        void clear();
+        static size_t block_size(size_t size) {
+            return (size + COMPACT_CLASS_SIZE - 1) / COMPACT_CLASS_SIZE * COMPACT_CLASS_SIZE;
+        }
+        uint64_t slab_bytes() const { return _slabs.size() * (uint64_t)COMPACT_SLAB_SIZE; }
+
+    private:
+        // a free block starts with the pointer to the next free block of its class
+        uint8_t* _free[COMPACT_CLASSES] = {};
+        std::vector<std::unique_ptr<uint8_t[]>> _slabs;
+};
+
+class PageCompactor {
+    public:
+        PageCompactor() = default;
+
+        // allocates the tracking state, call before the controller is started
+        // only for private anonymous memory (not for shared memory segments)
+        bool init(uint64_t mem_size, uint32_t cold_passes, uint32_t scan_interval_ms);
+        // decompresses every page and frees the pool, call after the controller stopped
+        void release(uint8_t* mem);
+        bool enabled() const { return _enabled; }
+        // pages in [address, address+length) are never compressed (e.g. file backed pages)
+        void exclude(uint64_t address, uint64_t length);
+        // forgets the compressed pages in [address, address+length), the memory there was released
+        void discard(uint64_t address, uint64_t length);
+        // only the first mem_size bytes are accessible -> the idle scan stops there
+        // controller thread (or before start())
+        void set_limit(uint64_t mem_size);
+
+        // controller thread: before every access of [address, address+size)
+        inline void touch(uint8_t* mem, uint64_t address, uint64_t size) {
+            uint64_t first = address >> COMPACT_PAGE_SHIFT;
+            uint64_t last = (address + (size ? size - 1 : 0)) >> COMPACT_PAGE_SHIFT;
+            for(uint64_t page = first; page <= last && page < _pages; page++) {
+                _accessed[page >> 6] |= 1ULL << (page & 63);
+                if(_compressed[page >> 6] & (1ULL << (page & 63))) {
+                    decompress_page(mem, page);
+                }
+            }
+        }
+        // controller thread: when there is nothing else to do
+        // returns early as soon as a request waits in pending
+        void idle_step(uint8_t* mem, const RingBuffer* pending = nullptr);
+
+        // Counters:
+        uint64_t compressed_pages() const { return _compressed_pages.load(std::memory_order_relaxed); }
+        uint64_t zero_pages() const { return _zero_pages.load(std::memory_order_relaxed); }
+        uint64_t pool_bytes() const { return _pool_bytes.load(std::memory_order_relaxed); }
+        uint64_t slab_bytes() const { return _slab_bytes.load(std::memory_order_relaxed); }
+        uint64_t decompressions() const { return _decompressions.load(std::memory_order_relaxed); }
+        // resident memory given back to the system minus the size of the pool
+        uint64_t saved_bytes() const;
+        void debug_state() const;
+
+    private:
+        void scan_page(uint8_t* mem, uint64_t page);
+        bool compress_page(uint8_t* mem, uint64_t page);
+        void decompress_page(uint8_t* mem, uint64_t page);
+        // gives the pool block of a page back
+        void release_block(uint64_t page);
+        void counter_add(std::atomic<uint64_t>& counter, int64_t value) {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        bool _enabled = false;
+        uint64_t _pages = 0;
+        // pages inside the current guest size, _limit <= _pages
+        uint64_t _limit = 0;
+        uint32_t _cold_passes = 0;
+        std::chrono::milliseconds _scan_interval{0};
+        std::chrono::steady_clock::time_point _last_pass;
+        uint64_t _cursor = 0;
+        bool _in_pass = false;
+        uint32_t _idle_count = 0;
+
+        std::vector<uint64_t> _accessed;
+        std::vector<uint64_t> _compressed;
+        std::vector<uint64_t> _excluded;
+        // number of scans without access, saturates
+        std::vector<uint8_t> _age;
+        // compressed data per page, nullptr for zero pages
+        CompressedPool _blocks;
+        std::vector<uint8_t*> _pool;
+        std::vector<uint16_t> _pool_size;
+        uint8_t _scratch[COMPACT_PAGE_SIZE];
+
+        std::atomic<uint64_t> _compressed_pages = 0;
+        std::atomic<uint64_t> _zero_pages = 0;
+        std::atomic<uint64_t> _pool_bytes = 0;
+        std::atomic<uint64_t> _slab_bytes = 0;
+        std::atomic<uint64_t> _decompressions = 0;
+};
+
+#endif // PAGE_COMPACTOR_HPP
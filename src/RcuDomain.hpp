@@ -0,0 +1,63 @@
+#ifndef RCU_DOMAIN_HPP
+#define RCU_DOMAIN_HPP
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// NOTICE:
+// Minimal RCU for data which is read by one producer thread on every request
+// and changed rarely by a management thread (e.g. the routing table of the handler).
+// The reader only stores an epoch counter (odd = inside a read section), no lock and no
+// atomic read-modify-write. The expensive part is on the writer side: membarrier() makes
+// the store of the reader visible, so the reader does not need a full fence.
+// Without membarrier (old kernels) the reader falls back to a seq_cst fence.
+// Usage:
+//   reader:  enter(); table = ptr.load(acquire); ... use table ... leave();
+//   writer:  ptr.store(new_table, release); synchronize(); delete old_table;
+
+class RcuDomain {
+    public:
+        RcuDomain() {
+            _membarrier = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+        }
+
+        inline void enter() {
+            _epoch.store(_epoch.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if(_membarrier) {
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            } else {
+                // the epoch has to be visible before the protected pointer is loaded
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        inline void leave() {
+            _epoch.store(_epoch.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // waits until the reader left the read section it was in (if any)
+        // after this no reader can use data which was unpublished before the call
+        void synchronize() {
+            if(_membarrier) {
+                syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+            } else {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            uint64_t epoch = _epoch.load(std::memory_order_acquire);
+            if((epoch & 1) == 0) {
+                return;
+            }
+            while(_epoch.load(std::memory_order_acquire) == epoch) {
+                std::this_thread::yield();
+            }
+        }
+
+    private:
+        std::atomic<uint64_t> _epoch = 0;
+        bool _membarrier = false;
+};
+
+#endif // RCU_DOMAIN_HPP
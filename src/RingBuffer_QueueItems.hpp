@@ -1,32 +1,41 @@
 #ifndef RINGBUFFER_QUEUEITEMS_HPP
 #define RINGBUFFER_QUEUEITEMS_HPP
 
+#include <atomic>
+#include <cstddef>
+#include <iostream>
 #include "global_defines.hpp"
 #define MAX_REQUESTS 20
+#define MAX_COMPLETIONS 64
 
-class RingBuffer {
+// single-producer/single-consumer ring of slot indices
+// only indices are stored (no pointers) so the ring can be placed in shared memory
+// and be used by two processes which map the queue at different addresses
+// T can be any trivially copyable type (e.g. the code write events)
+template<size_t SIZE, typename T = uint8_t>
+class SlotRing {
     public:
-    RingBuffer() = default;
-    ~RingBuffer() {
-        for(queue_item* r : _requests) {
-            r = nullptr;
-        }
-    }
-    bool producer_push(queue_item* request) {
+    SlotRing() = default;
+    bool producer_push(T slot) {
         size_t head = _head.load(std::memory_order_relaxed);
         size_t tail = _tail.load(std::memory_order_acquire);
 
-        if((head+1) % MAX_REQUESTS == tail) {
+        if((head+1) % SIZE == tail) {
             // Buffer is full
             return false;
         }
 
-        _requests[head] = request;
-        _head.store((head+1) % MAX_REQUESTS, std::memory_order_release);
+        _slots[head] = slot;
+        _head.store((head+1) % SIZE, std::memory_order_release);
         return true;
     }
 
-    bool consumer_pop(queue_item** item) {
+    // consumer side: nothing to pop
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_relaxed);
+    }
+
+    bool consumer_pop(T* slot) {
         size_t head = _head.load(std::memory_order_acquire);
         size_t tail = _tail.load(std::memory_order_relaxed);
 
@@ -35,37 +44,38 @@ class RingBuffer {
             return false;
         }
 
-        *item = _requests[tail];
-#ifdef CONTROLLER_DEBUG
-        _requests[tail] = nullptr;
-#endif        
-        _tail.store((tail+1) % MAX_REQUESTS, std::memory_order_release);
+        *slot = _slots[tail];
+        _tail.store((tail+1) % SIZE, std::memory_order_release);
 
         return true;
     }
 
 
 #ifdef CONTROLLER_DEBUG
-    void debug_state() const {
+    // queue is the slot array the indices point into
+    void debug_state(const queue_item* queue) const {
+        size_t head = _head.load();
+        size_t tail = _tail.load();
         std::cout << "RingBuffer State:" << std::endl;
-        std::cout << "  head: " << _head.load() << std::endl;
-        std::cout << "  tail: " << _tail.load() << std::endl;
-        std::cout << "  slots: " << MAX_REQUESTS << std::endl;
-        for (size_t i = 0; i < MAX_REQUESTS; ++i) {
-            if(_requests[i] != nullptr) {
-                std::cout << "Operation: " << _requests[i]->op << " address: " << _requests[i]->address << " data: " << _requests[i]->data << " size: " << _requests[i]->size << " slot: " << _requests[i]->slot << std::endl;
-            } else {
-                std::cout << "[NULL]" << std::endl;
-            }
-            
+        std::cout << "  head: " << head << std::endl;
+        std::cout << "  tail: " << tail << std::endl;
+        std::cout << "  slots: " << SIZE << std::endl;
+        for (size_t i = tail; i != head; i = (i+1) % SIZE) {
+            const queue_item* r = &queue[_slots[i]];
+            std::cout << "Operation: " << r->op << " address: " << r->address << " data: " << r->data << " size: " << r->size << " slot: " << r->slot << std::endl;
         }
         std::cout << std::endl;
     }
 #endif
     private:
-    queue_item* _requests[MAX_REQUESTS];
+    T _slots[SIZE];
     std::atomic<size_t> _head{0};
     std::atomic<size_t> _tail{0};
 };
 
-#endif // RINGBUFFER_QUEUEITEMS_HPP
\ No newline at end of file
+// requests from the producer to the controller
+using RingBuffer = SlotRing<MAX_REQUESTS>;
+// finished READs from the controller to the producer
+using CompletionRing = SlotRing<MAX_COMPLETIONS>;
+
+#endif // RINGBUFFER_QUEUEITEMS_HPP
@@ -0,0 +1,170 @@
+#include "SharedMemoryTransport.hpp"
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+SharedMemorySegment::~SharedMemorySegment() {
+    close();
+}
+
+bool SharedMemorySegment::create(const std::string& name, uint64_t memory_size, uint32_t channels) {
+    if(is_open() || channels == 0) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    int fd;
+    if(name.empty()) {
+        fd = memfd_create("emucore_memory", 0);
+    } else {
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if(fd == -1) {
+        SET_MEM_ERROR(ALLOC_ERROR);
+        return false;
+    }
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t channel_offset = align_up(sizeof(shm_header), alignof(queue_channel));
+    uint64_t memory_offset = align_up(channel_offset + channels * sizeof(queue_channel), page);
+    uint64_t total_size = memory_offset + align_up(memory_size, page);
+    // the guest memory is zero filled by the kernel on first touch
+    if(ftruncate(fd, total_size) == -1) {
+        ::close(fd);
+        if(!name.empty()) {
+            shm_unlink(name.c_str());
+        }
+        SET_MEM_ERROR(ALLOC_ERROR);
+        return false;
+    }
+    _name = name;
+    _total_size = total_size;
+    if(!map(fd, true)) {
+        return false;
+    }
+    _header->version = SHM_VERSION;
+    _header->channels = channels;
+    _header->channel_offset = channel_offset;
+    _header->memory_offset = memory_offset;
+    _header->memory_size = memory_size;
+    _header->total_size = total_size;
+    _header->attached.store(1, std::memory_order_relaxed);
+    for(uint32_t i = 0; i < channels; i++) {
+        new (_base + channel_offset + i * sizeof(queue_channel)) queue_channel();
+    }
+    // the magic is written last -> an opened segment is always initialized
+    _header->magic.store(SHM_MAGIC, std::memory_order_release);
+#ifdef DEBUG
+    LOG_DEBUG("[SHARED MEMORY]: created segment: "+name+" size: "+std::to_string(total_size)+" channels: "+std::to_string(channels));
+#endif
+    return true;
+}
+
+bool SharedMemorySegment::open(const std::string& name) {
+    if(is_open()) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if(fd == -1) {
+        SET_MEM_ERROR(MEMORY_ERROR);
+        return false;
+    }
+    _name = name;
+    return open_fd(fd);
+}
+
+bool SharedMemorySegment::open_fd(int fd) {
+    if(is_open()) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) == -1 || (uint64_t)info.st_size < sizeof(shm_header)) {
+        ::close(fd);
+        SET_MEM_ERROR(MEMORY_ERROR);
+        return false;
+    }
+    _total_size = (uint64_t)info.st_size;
+    if(!map(fd, false)) {
+        return false;
+    }
+    if(_header->magic.load(std::memory_order_acquire) != SHM_MAGIC || _header->version != SHM_VERSION
+        || _header->total_size != _total_size) {
+#ifdef DEBUG
+        LOG_DEBUG("[SHARED MEMORY]: segment is not initialized or has the wrong version");
+#endif
+        close();
+        SET_MEM_ERROR(MEMORY_ERROR);
+        return false;
+    }
+    _header->attached.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool SharedMemorySegment::map(int fd, bool created) {
+    void* mem = mmap(0, _total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mem == MAP_FAILED) {
+        ::close(fd);
+        if(created && !_name.empty()) {
+            shm_unlink(_name.c_str());
+        }
+        SET_MEM_ERROR(ALLOC_ERROR);
+        return false;
+    }
+    _fd = fd;
+    _base = (uint8_t*)mem;
+    _header = (shm_header*)mem;
+    return true;
+}
+
+void SharedMemorySegment::close() {
+    if(_base == nullptr) {
+        return;
+    }
+    if(_header->magic.load(std::memory_order_acquire) == SHM_MAGIC) {
+        _header->attached.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if(munmap(_base, _total_size) == -1) {
+        SET_MEM_ERROR(FREE_ERROR);
+    }
+    ::close(_fd);
+    _fd = -1;
+    _base = nullptr;
+    _header = nullptr;
+    _total_size = 0;
+}
+
+bool SharedMemorySegment::unlink() {
+    if(_name.empty()) {
+        // memfd segments have no name
+        return true;
+    }
+    return shm_unlink(_name.c_str()) == 0;
+}
+
+uint32_t SharedMemorySegment::channels() const {
+    return _header == nullptr ? 0 : _header->channels;
+}
+
+queue_channel* SharedMemorySegment::get_channel(uint32_t index) {
+    if(_header == nullptr || index >= _header->channels) {
+        return nullptr;
+    }
+    return (queue_channel*)(_base + _header->channel_offset + index * sizeof(queue_channel));
+}
+
+uint8_t* SharedMemorySegment::memory() {
+    if(_header == nullptr) {
+        return nullptr;
+    }
+    return _base + _header->memory_offset;
+}
+
+uint64_t SharedMemorySegment::memory_size() const {
+    return _header == nullptr ? 0 : _header->memory_size;
+}
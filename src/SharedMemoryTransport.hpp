@@ -0,0 +1,78 @@
+#ifndef SHARED_MEMORY_TRANSPORT_HPP
+#define SHARED_MEMORY_TRANSPORT_HPP
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "MemControllerAPI.hpp"
+
+// NOTICE:
+// Shared memory transport: the queue channels and the guest memory live in one
+// shm_open/memfd segment so the controller can run in its own process.
+// Every producer process needs its own channel (the rings are single producer),
+// all channels share the guest memory.
+//
+// Layout of the segment (offsets are stored in the header):
+// | shm_header | queue_channel 0 .. n-1 (64 byte aligned) | guest memory (page aligned) |
+//
+// Controller process:
+//     SharedMemorySegment segment;
+//     segment.create("/emucore_ram", ONE_GB, 1);
+//     controller->init_shared(segment, 0);
+//     controller->start();
+// Producer process:
+//     SharedMemorySegment segment;
+//     segment.open("/emucore_ram");
+//     producer->init_shared(segment, 0);   // never start() the producer side
+//     handler.add_controller(producer);
+
+#define SHM_MAGIC 0x454D55434F52454DULL // "EMUCOREM"
+#define SHM_VERSION 6
+
+struct shm_header {
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t channels;
+    uint64_t channel_offset;
+    uint64_t memory_offset;
+    uint64_t memory_size;
+    uint64_t total_size;
+    // number of processes which mapped the segment
+    std::atomic<uint32_t> attached;
+};
+
+class SharedMemorySegment {
+    public:
+        SharedMemorySegment() = default;
+        ~SharedMemorySegment();
+        SharedMemorySegment(const SharedMemorySegment&) = delete;
+        SharedMemorySegment& operator=(const SharedMemorySegment&) = delete;
+
+        // creates a new segment, an empty name creates an anonymous memfd segment
+        // which can be shared with fork() or by passing fd() to another process
+        bool create(const std::string& name, uint64_t memory_size, uint32_t channels = 1);
+        // maps an existing segment created by another process
+        bool open(const std::string& name);
+        bool open_fd(int fd);
+        // unmaps the segment, the segment itself lives until it is unlinked and unmapped everywhere
+        void close();
+        // removes the name of a named segment
+        bool unlink();
+
+        bool is_open() const { return _base != nullptr; }
+        int fd() const { return _fd; }
+        uint32_t channels() const;
+        queue_channel* get_channel(uint32_t index);
+        uint8_t* memory();
+        uint64_t memory_size() const;
+
+    private:
+        bool map(int fd, bool created);
+
+        std::string _name;
+        int _fd = -1;
+        uint8_t* _base = nullptr;
+        uint64_t _total_size = 0;
+        shm_header* _header = nullptr;
+};
+
+#endif // SHARED_MEMORY_TRANSPORT_HPP
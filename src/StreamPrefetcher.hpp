@@ -0,0 +1,201 @@
+#ifndef STREAM_PREFETCHER_HPP
+#define STREAM_PREFETCHER_HPP
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <immintrin.h>
+
+// NOTICE:
+// Software prefetcher for the controller thread.
+// The last PREFETCH_STREAMS access streams are tracked, a stream with the same stride
+// for PREFETCH_CONFIDENCE accesses gets prefetched "distance" cachelines ahead.
+// Issued lines are remembered in a small direct mapped table:
+// a later access to the line counts as useful, an overwritten unused line as wasted.
+// Everything is used by the controller thread only, except the configuration
+// (only change it while the prefetcher is disabled) and the counters.
+
+#define PREFETCH_STREAMS 4
+#define PREFETCH_CONFIDENCE 2
+#define PREFETCH_WINDOW 4096
+#define PREFETCH_HISTORY 64
+#define PREFETCH_MAX_REGIONS 8
+#define PREFETCH_LINE 64
+#define PREFETCH_PAGE 4096
+
+struct prefetch_stream {
+    uint64_t last_address = 0;
+    int64_t stride = 0;
+    uint32_t confidence = 0;
+    uint64_t last_used = 0;
+    bool valid = false;
+};
+
+struct prefetch_region {
+    uint64_t start = 0;
+    uint64_t end = 0;
+};
+
+class StreamPrefetcher {
+    public:
+    StreamPrefetcher() = default;
+
+    // Configuration:
+    void enable(bool on) { _enabled.store(on, std::memory_order_release); }
+    bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+    // distance in cachelines (or strides for strides bigger than a cacheline)
+    void set_distance(uint32_t lines) { _distance = lines == 0 ? 1 : lines; }
+    // also touch the first byte of the next page so the page walk is done ahead of the guest
+    void set_touch_pages(bool on) { _touch_pages = on; }
+    // prefetching is limited to the given ranges (relative to the controller), no region = everything
+    bool add_region(uint64_t start, uint64_t end) {
+        if(_region_count >= PREFETCH_MAX_REGIONS || end <= start) {
+            return false;
+        }
+        _regions[_region_count].start = start;
+        _regions[_region_count].end = end;
+        _region_count++;
+        return true;
+    }
+    void clear_regions() { _region_count = 0; }
+
+    // Counters:
+    uint64_t issued() const { return _issued.load(std::memory_order_relaxed); }
+    uint64_t useful() const { return _useful.load(std::memory_order_relaxed); }
+    uint64_t wasted() const { return _wasted.load(std::memory_order_relaxed); }
+    void reset_counters() {
+        _issued.store(0, std::memory_order_relaxed);
+        _useful.store(0, std::memory_order_relaxed);
+        _wasted.store(0, std::memory_order_relaxed);
+    }
+    void debug_state() const {
+        std::cout << "Prefetcher: issued: " << issued() << " useful: " << useful() << " wasted: " << wasted() << std::endl;
+    }
+
+    // called by the controller thread after every request
+    // mem is the begin of the guest memory, size its size in bytes
+    inline void access(uint8_t* mem, uint64_t size, uint64_t address) {
+        _clock++;
+        uint64_t line = address / PREFETCH_LINE;
+        check_history(line);
+        if(!in_region(address)) {
+            return;
+        }
+        prefetch_stream* stream = find_stream(address);
+        int64_t stride = (int64_t)(address - stream->last_address);
+        if(stride == 0) {
+            // same address again (e.g. WRITE followed by READ) or a new stream
+            stream->valid = true;
+            stream->last_used = _clock;
+            return;
+        }
+        uint64_t last_line = stream->last_address / PREFETCH_LINE;
+        if(stream->valid && stride == stream->stride) {
+            if(stream->confidence < PREFETCH_CONFIDENCE) {
+                stream->confidence++;
+            }
+        } else {
+            stream->stride = stride;
+            stream->confidence = stream->valid ? 1 : 0;
+        }
+        stream->valid = true;
+        stream->last_address = address;
+        stream->last_used = _clock;
+        if(stream->confidence < PREFETCH_CONFIDENCE) {
+            return;
+        }
+        int64_t ahead;
+        if(stride > -PREFETCH_LINE && stride < PREFETCH_LINE) {
+            // small strides: one prefetch per new cacheline
+            if(line == last_line) {
+                return;
+            }
+            ahead = (stride > 0 ? 1 : -1) * (int64_t)_distance * PREFETCH_LINE;
+        } else {
+            ahead = stride * (int64_t)_distance;
+        }
+        uint64_t target = address + ahead;
+        if(target >= size) {
+            return;
+        }
+        issue(mem, target);
+    }
+
+    private:
+    inline bool in_region(uint64_t address) const {
+        if(_region_count == 0) {
+            return true;
+        }
+        for(uint32_t i = 0; i < _region_count; i++) {
+            if(address >= _regions[i].start && address < _regions[i].end) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the stream this address continues or the least recently used stream
+    inline prefetch_stream* find_stream(uint64_t address) {
+        prefetch_stream* lru = &_streams[0];
+        for(int i = 0; i < PREFETCH_STREAMS; i++) {
+            prefetch_stream* s = &_streams[i];
+            if(s->valid) {
+                uint64_t distance = address > s->last_address ? address - s->last_address : s->last_address - address;
+                if(distance <= PREFETCH_WINDOW) {
+                    return s;
+                }
+            }
+            if(!s->valid || s->last_used < lru->last_used) {
+                lru = s;
+            }
+        }
+        lru->valid = false;
+        lru->last_address = address;
+        lru->confidence = 0;
+        return lru;
+    }
+
+    inline void check_history(uint64_t line) {
+        uint64_t& entry = _history[line % PREFETCH_HISTORY];
+        // lines are stored +1 so 0 means empty
+        if(entry == line + 1) {
+            _useful.store(_useful.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            entry = 0;
+        }
+    }
+
+    inline void issue(uint8_t* mem, uint64_t target) {
+        uint64_t line = target / PREFETCH_LINE;
+        uint64_t& entry = _history[line % PREFETCH_HISTORY];
+        if(entry == line + 1) {
+            // already in flight
+            return;
+        }
+        if(entry != 0) {
+            _wasted.store(_wasted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        entry = line + 1;
+        if(_touch_pages && (target % PREFETCH_PAGE) < PREFETCH_LINE) {
+            // first line of a new page -> do the page walk now
+            (void)*(volatile uint8_t*)(mem + target);
+        } else {
+            _mm_prefetch((const char*)(mem + target), _MM_HINT_T0);
+        }
+        _issued.store(_issued.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> _enabled = false;
+    uint32_t _distance = 4;
+    bool _touch_pages = false;
+    prefetch_region _regions[PREFETCH_MAX_REGIONS];
+    uint32_t _region_count = 0;
+
+    prefetch_stream _streams[PREFETCH_STREAMS];
+    uint64_t _history[PREFETCH_HISTORY] = {};
+    uint64_t _clock = 0;
+
+    std::atomic<uint64_t> _issued = 0;
+    std::atomic<uint64_t> _useful = 0;
+    std::atomic<uint64_t> _wasted = 0;
+};
+
+#endif // STREAM_PREFETCHER_HPP
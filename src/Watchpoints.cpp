@@ -0,0 +1,78 @@
+#include "Watchpoints.hpp"
+#include "Error_Reg.hpp"
+#include "Logger.hpp"
+#include "global_defines.hpp"
+#include <string>
+
+int Watchpoints::add(uint64_t address, uint64_t length, uint8_t kinds) {
+    if(length == 0 || (kinds & WATCH_ACCESS) == 0) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return -1;
+    }
+    for(uint32_t i = 0; i < MAX_WATCHPOINTS; i++) {
+        if(_entries[i].active.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        _entries[i].start.store(address, std::memory_order_relaxed);
+        _entries[i].end.store(address + length, std::memory_order_relaxed);
+        _entries[i].kinds.store(kinds, std::memory_order_relaxed);
+        _entries[i].active.store(true, std::memory_order_release);
+        // the filter bits are set after the entry is complete
+        rebuild_filter();
+        _armed.fetch_add(1, std::memory_order_release);
+#ifdef DEBUG
+        LOG_DEBUG("[WATCHPOINTS]: watchpoint "+std::to_string(i)+" at: "+std::to_string(address)+" length: "+std::to_string(length));
+#endif
+        return (int)i;
+    }
+    SET_STANDARD_ERROR(UNDEFINED_ERROR);
+    return -1;
+}
+
+bool Watchpoints::remove(int index) {
+    if(index < 0 || index >= MAX_WATCHPOINTS || !_entries[index].active.load(std::memory_order_relaxed)) {
+        SET_STANDARD_ERROR(UNDEFINED_ERROR);
+        return false;
+    }
+    _entries[index].active.store(false, std::memory_order_release);
+    _armed.fetch_sub(1, std::memory_order_release);
+    rebuild_filter();
+    return true;
+}
+
+void Watchpoints::clear() {
+    for(uint32_t i = 0; i < MAX_WATCHPOINTS; i++) {
+        if(_entries[i].active.load(std::memory_order_relaxed)) {
+            remove((int)i);
+        }
+    }
+}
+
+void Watchpoints::rebuild_filter() {
+    // the new filter is computed first, every word is stored once
+    // -> bits of the remaining watchpoints are never cleared in between
+    uint64_t filter[WATCH_FILTER_BITS / 64] = {};
+    for(uint32_t i = 0; i < MAX_WATCHPOINTS; i++) {
+        if(!_entries[i].active.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        uint64_t first = _entries[i].start.load(std::memory_order_relaxed) >> WATCH_PAGE_SHIFT;
+        uint64_t last = (_entries[i].end.load(std::memory_order_relaxed) - 1) >> WATCH_PAGE_SHIFT;
+        if(last - first >= WATCH_FILTER_BITS) {
+            // the range covers every bit
+            for(uint64_t& word : filter) {
+                word = ~0ULL;
+            }
+            break;
+        }
+        for(uint64_t page = first; page <= last; page++) {
+            uint64_t bit = page & (WATCH_FILTER_BITS - 1);
+            filter[bit >> 6] |= 1ULL << (bit & 63);
+        }
+    }
+    for(uint64_t i = 0; i < WATCH_FILTER_BITS / 64; i++) {
+        if(_filter[i].load(std::memory_order_relaxed) != filter[i]) {
+            _filter[i].store(filter[i], std::memory_order_release);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef WATCHPOINTS_HPP
+#define WATCHPOINTS_HPP
+#include <atomic>
+#include <cstdint>
+
+// NOTICE:
+// Data watchpoints for a guest debugger.
+// The controller only looks at the watchpoints while at least one is armed:
+// first a coarse filter (one bit per guest page, hashed into WATCH_FILTER_BITS bits),
+// only if the bit is set the exact ranges are compared.
+// The debugger thread can add and remove watchpoints while the controller runs.
+// A hit does not stop the access, it is reported in queue_item::watchpoint
+// (1 + index of the watchpoint) and the producer traps afterwards.
+// Addresses are relative to the controller (guest address - _guest_base).
+
+#define MAX_WATCHPOINTS 16
+#define WATCH_PAGE_SHIFT 12
+#define WATCH_FILTER_BITS 65536
+
+enum watch_kind : uint8_t {
+    WATCH_READ = 1,
+    WATCH_WRITE = 2,
+    WATCH_ACCESS = 3,
+};
+
+class Watchpoints {
+    public:
+        Watchpoints() = default;
+
+        // returns the index of the watchpoint or -1 if all are used
+        int add(uint64_t address, uint64_t length, uint8_t kinds);
+        bool remove(int index);
+        void clear();
+
+        inline bool armed() const { return _armed.load(std::memory_order_relaxed) != 0; }
+        uint64_t hits() const { return _hits.load(std::memory_order_relaxed); }
+
+        // controller side: 0 = no hit, else 1 + index of the first matching watchpoint
+        inline uint32_t check(uint64_t address, uint64_t size, uint8_t kind) {
+            uint64_t end = address + (size ? size : 1);
+            uint64_t first = address >> WATCH_PAGE_SHIFT;
+            uint64_t last = (end - 1) >> WATCH_PAGE_SHIFT;
+            // an access touches at most two pages
+            if(!filter_bit(first) && (last == first || !filter_bit(last))) {
+                return 0;
+            }
+            for(uint32_t i = 0; i < MAX_WATCHPOINTS; i++) {
+                if(!_entries[i].active.load(std::memory_order_acquire)) {
+                    continue;
+                }
+                if((_entries[i].kinds.load(std::memory_order_relaxed) & kind)
+                    && address < _entries[i].end.load(std::memory_order_relaxed)
+                    && end > _entries[i].start.load(std::memory_order_relaxed)) {
+                    _hits.store(_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    return i + 1;
+                }
+            }
+            return 0;
+        }
+
+    private:
+        struct entry {
+            std::atomic<uint64_t> start = 0;
+            std::atomic<uint64_t> end = 0;
+            std::atomic<uint8_t> kinds = 0;
+            std::atomic<bool> active = false;
+        };
+
+        inline bool filter_bit(uint64_t page) const {
+            uint64_t bit = page & (WATCH_FILTER_BITS - 1);
+            return _filter[bit >> 6].load(std::memory_order_acquire) & (1ULL << (bit & 63));
+        }
+        // recomputes the filter from the active watchpoints
+        void rebuild_filter();
+
+        entry _entries[MAX_WATCHPOINTS];
+        std::atomic<uint64_t> _filter[WATCH_FILTER_BITS / 64] = {};
+        std::atomic<uint32_t> _armed = 0;
+        std::atomic<uint64_t> _hits = 0;
+};
+
+#endif // WATCHPOINTS_HPP
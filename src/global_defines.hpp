@@ -20,14 +20,29 @@
 // make sure to define the endianness of the system
 // this is only for the emulator the compiler does this automatically
 // use either: IS_BIG_ENDIAN or IS_LITTLE_ENDIAN
+// this is the default guest endianness of every controller, it can be changed at runtime
+// per controller (set_endianness) and per region (add_endian_region)
 #define IS_LITTLE_ENDIAN
 //#define IS_BIG_ENDIAN
 
+enum class endianness {
+    LITTLE = 0,
+    BIG = 1,
+};
+#ifdef IS_BIG_ENDIAN
+    #define DEFAULT_ENDIANNESS endianness::BIG
+#else
+    #define DEFAULT_ENDIANNESS endianness::LITTLE
+#endif
+
 
 enum memory_ops {
     NONE = 0,
     READ = 1,
     WRITE = 2,
+    RESIZE = 3, // internal: data = new size of the guest memory
+    GATHER = 4, // vector load, lanes in queue_channel::vectors[slot]
+    SCATTER = 5, // vector store, lanes in queue_channel::vectors[slot]
 };
 
 struct queue_item {
@@ -36,6 +51,8 @@ struct queue_item {
     uint64_t data = 0;
     uint64_t size = 0;
     uint64_t slot = 0;
+    // set by the controller while watchpoints are armed: 1 + index of the watchpoint hit, 0 = no hit
+    uint32_t watchpoint = 0;
 };
 
 
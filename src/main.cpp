@@ -1,13 +1,102 @@
 #include "MemoryControllerHandler.hpp"
+#include "MemoryCoroutines.hpp"
 #include "Logger.hpp"
 #include <iostream>
 #include <chrono>
+
+#ifdef PERFORMANCE_TEST
+// producer and controller spinning on one cpu only progress with every scheduler tick (ms per round trip)
+#define SHARED_CPU_ROUNDS 200
+
+// measures the round trip latency (producer -> controller -> producer) of a READ
+// for every placement of the controller thread relative to the producer
+void latency_per_placement(MemoryControllerHandler& handler, int64_t rounds) {
+    if(!handler.load_topology()) {
+        std::cerr << "[MAIN]: no cpu topology available, skipping latency test" << std::endl;
+        return;
+    }
+    int producer_cpu = CpuTopology::current_cpu();
+    CpuTopology::pin_current_thread(producer_cpu);
+    Memory_Controller_Core* con = handler.get_controller(0);
+    const placement placements[] = {
+        placement::UNPINNED,
+        placement::SAME_CPU,
+        placement::SMT_SIBLING,
+        placement::SAME_L3,
+        placement::SAME_NODE,
+        placement::REMOTE_NODE,
+    };
+    std::cout << "Round trip latency, producer on cpu " << producer_cpu << ":" << std::endl;
+    for(placement where : placements) {
+        int cpu = handler.place_controller(0, producer_cpu, where);
+        if(where != placement::UNPINNED && cpu == -1) {
+            std::cout << "  " << CpuTopology::placement_name(where) << ": no cpu available" << std::endl;
+            continue;
+        }
+        int64_t placement_rounds = rounds;
+        bool shared_cpu = cpu == producer_cpu || handler.get_topology().cpus().size() < 2;
+        if(shared_cpu && placement_rounds > SHARED_CPU_ROUNDS) {
+            placement_rounds = SHARED_CPU_ROUNDS;
+        }
+        queue_item in;
+        in.op = memory_ops::READ;
+        in.size = 8;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int64_t i = 0; i < placement_rounds; i++) {
+            in.address = (i * 8) % (ONE_GB - 8);
+            int index = con->add_to_input_queue(in);
+            if(index == -1) {
+                break;
+            }
+            con->get_from_output_queue(index);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        std::cout << "  " << CpuTopology::placement_name(where) << " (cpu " << cpu << "): " << duration_ns / placement_rounds << " ns"
+                  << (shared_cpu ? " (shared cpu, " + std::to_string(placement_rounds) + " rounds)" : "") << std::endl;
+    }
+    // back to the default placement for the controllers
+    handler.place_controllers(producer_cpu);
+}
+#endif
+
+#ifdef PERFORMANCE_TEST
+// a guest context: every context works on its own 8 byte lane
+mem_task guest_context(MemoryScheduler& mem, uint64_t id, uint64_t contexts, int64_t ops, int64_t& mismatches) {
+    for(int64_t i = 0; i < ops; i++) {
+        uint64_t address = (((i * contexts + id) * 8) % (ONE_GB - 8));
+        co_await mem.write(address, i + id, 8);
+        uint64_t data = co_await mem.read(address, 8);
+        if(data != (uint64_t)(i + id)) {
+            mismatches++;
+        }
+    }
+}
+
+// many guest contexts on one host thread, requests of all contexts are in flight at the same time
+void coroutine_contexts(MemoryControllerHandler& handler, uint64_t contexts, int64_t ops) {
+    MemoryScheduler scheduler(handler);
+    int64_t mismatches = 0;
+    for(uint64_t id = 0; id < contexts; id++) {
+        scheduler.spawn(guest_context(scheduler, id, contexts, ops, mismatches));
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    scheduler.run();
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    std::cout << "Coroutines: " << contexts << " contexts, " << contexts * ops * 2 << " ops, " << duration_ms << " ms, mismatches: " << mismatches << std::endl;
+}
+#endif
+
 int main() {
 #ifdef PERFORMANCE_TEST
     // This is the performance example:
     MemoryControllerHandler handler;
     Memory_Controller_Core* mem_controller = new Memory_Controller_Core();
     mem_controller->init(ONE_GB);
+    // the benchmark walks the memory sequentially
+    mem_controller->prefetcher.set_distance(8);
+    mem_controller->prefetcher.enable(true);
     mem_controller->start();
     // the additional controller is not used its only to showcase the usage:
     handler.add_controller(mem_controller);
@@ -65,6 +154,9 @@ int main() {
     auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
     std::cout << "Ops: " << ops << std::endl;
     std::cout << "Done. Duration: " << std::chrono::duration_cast<std::chrono::seconds>(end - start).count() << "s"  << ", " << duration_ms << " ms"<< std::endl;
+    handler.get_controller(0)->prefetcher.debug_state();
+    latency_per_placement(handler, 1000000);
+    coroutine_contexts(handler, 32, 1000000);
     handler.stop_controllers();
 #else
     // Example 1: